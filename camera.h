@@ -0,0 +1,110 @@
+// Copyright (C) 2005-2013 Robert Kooima
+//
+// This file is part of Hippo.
+//
+// Hippo is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// Hippo is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along
+// with Hippo. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <string.h>
+#include <math.h>
+
+// The camera of hipviz, shared with hipbench so that a replayed path culls
+// exactly the volume that was viewed. Matrices are row-major 4x4, as are the
+// mat4 of gl.hpp. Angles are in degrees.
+
+//-----------------------------------------------------------------------------
+
+#define CAMERA_NEAR     1.0f
+#define CAMERA_FAR  10000.0f
+
+// Multiply matrices A and B giving M, which may not alias either.
+
+static inline void camera_mult(float *M, const float *A, const float *B)
+{
+    for     (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            M[i * 4 + j] = A[i * 4 + 0] * B[ 0 + j]
+                         + A[i * 4 + 1] * B[ 4 + j]
+                         + A[i * 4 + 2] * B[ 8 + j]
+                         + A[i * 4 + 3] * B[12 + j];
+}
+
+// Return the field of view with which to cull a query that lags by a frame,
+// widened to cover turning.
+
+static inline float camera_lag(float fov)
+{
+    return fminf(fov + 10.0f, 170.0f);
+}
+
+// Compute in P the projection of field of view v and aspect ratio a.
+
+static inline void camera_projection(float *P, float v, float a)
+{
+    const float n = CAMERA_NEAR;
+    const float f = CAMERA_FAR;
+    const float y = n * tanf(v * 0.017453292f / 2);
+    const float x = y * a;
+
+    const float M[16] = { n / x, 0,     0,                 0,
+                          0,     n / y, 0,                 0,
+                          0,     0,     (n + f) / (n - f), 2 * (n * f) / (n - f),
+                          0,     0,     -1,                0 };
+    memcpy(P, M, sizeof (M));
+}
+
+// Compute in M the model-view of a camera rotated by rx about X and ry about
+// Y, and translated by p unless p is NULL.
+
+static inline void camera_view(float *M, float rx, float ry, const double *p)
+{
+    const float a = rx * 0.017453292f;
+    const float b = ry * 0.017453292f;
+
+    const float X[16] = { 1, 0,        0,       0,
+                          0, cosf(a), -sinf(a), 0,
+                          0, sinf(a),  cosf(a), 0,
+                          0, 0,        0,       1 };
+    const float Y[16] = {  cosf(b), 0, sinf(b), 0,
+                           0,       1, 0,       0,
+                          -sinf(b), 0, cosf(b), 0,
+                           0,       0, 0,       1 };
+
+    camera_mult(M, X, Y);
+
+    if (p)
+    {
+        float R[16];
+        float T[16] = { 1, 0, 0, (float) p[0],
+                        0, 1, 0, (float) p[1],
+                        0, 0, 1, (float) p[2],
+                        0, 0, 0, 1 };
+
+        memcpy(R, M, sizeof (R));
+        camera_mult(M, R, T);
+    }
+}
+
+// Return nonzero if a catalog is viewed with the translation of the camera.
+// Tycho-2 is viewed from the origin, as its stars are too distant for motion
+// to matter, and a rebased catalog leaves the translation to its query.
+
+static inline int camera_moves(int tycho, int rebased)
+{
+    return tycho == 0 && rebased == 0;
+}
+
+#endif
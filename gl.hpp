@@ -43,6 +43,11 @@
 #include <cstdio>
 #include <cmath>
 
+#if defined(__SSE__) || defined(_M_X64)
+#  include <xmmintrin.h>
+#  define GL_SSE 1
+#endif
+
 //------------------------------------------------------------------------------
 
 #ifdef NDEBUG
@@ -287,7 +292,25 @@ namespace gl
 
     inline vec4 operator*(const mat4& A, const vec4& v)
     {
+#ifdef GL_SSE
+        __m128 c0 = _mm_loadu_ps(A[0]);
+        __m128 c1 = _mm_loadu_ps(A[1]);
+        __m128 c2 = _mm_loadu_ps(A[2]);
+        __m128 c3 = _mm_loadu_ps(A[3]);
+
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+        __m128 p =            _mm_mul_ps(c0, _mm_set1_ps(v[0]));
+        p = _mm_add_ps(p, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+        p = _mm_add_ps(p, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+        p = _mm_add_ps(p, _mm_mul_ps(c3, _mm_set1_ps(v[3])));
+
+        vec4 w;
+        _mm_storeu_ps(w.v, p);
+        return w;
+#else
         return vec4(A[0] * v, A[1] * v, A[2] * v, A[3] * v);
+#endif
     }
 
     /// Calculate the 3x3 matrix product of A and B.
@@ -308,6 +331,22 @@ namespace gl
     inline mat4 operator*(const mat4& A, const mat4& B)
     {
         mat4 M;
+#ifdef GL_SSE
+        const __m128 b0 = _mm_loadu_ps(B[0]);
+        const __m128 b1 = _mm_loadu_ps(B[1]);
+        const __m128 b2 = _mm_loadu_ps(B[2]);
+        const __m128 b3 = _mm_loadu_ps(B[3]);
+
+        for (int i = 0; i < 4; i++)
+        {
+            __m128 m =            _mm_mul_ps(_mm_set1_ps(A[i][0]), b0);
+            m = _mm_add_ps(m, _mm_mul_ps(_mm_set1_ps(A[i][1]), b1));
+            m = _mm_add_ps(m, _mm_mul_ps(_mm_set1_ps(A[i][2]), b2));
+            m = _mm_add_ps(m, _mm_mul_ps(_mm_set1_ps(A[i][3]), b3));
+            _mm_storeu_ps(M[i].v, m);
+        }
+        return M;
+#else
         for     (int i = 0; i < 4; i++)
             for (int j = 0; j < 4; j++)
                 M[i][j] = A[i][0] * B[0][j]
@@ -315,6 +354,7 @@ namespace gl
                         + A[i][2] * B[2][j]
                         + A[i][3] * B[3][j];
         return M;
+#endif
     }
 
     //--------------------------------------------------------------------------
@@ -0,0 +1,270 @@
+// Copyright (C) 2005-2013 Robert Kooima
+//
+// This file is part of Hippo.
+//
+// Hippo is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// Hippo is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along
+// with Hippo. If not, see <http://www.gnu.org/licenses/>.
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+#include "hippo.h"
+#include "camera.h"
+
+// Replay a camera path against a catalog without a display, timing the cull
+// and draw stages of each frame as hipviz would perform them. The draw stage
+// gathers the listed stars into a staging buffer, as would be uploaded to a
+// streaming vertex buffer, in place of rendering them.
+
+//-----------------------------------------------------------------------------
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int cmp(const void *a, const void *b)
+{
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Report the mean, median, 95th percentile, and maximum of n times.
+
+static void report(const char *name, double *t, size_t n)
+{
+    double s = 0;
+
+    for (size_t i = 0; i < n; i++)
+        s += t[i];
+
+    qsort(t, n, sizeof (double), cmp);
+
+    fprintf(stderr, "%s: mean %.3f  p50 %.3f  p95 %.3f  max %.3f ms\n", name,
+            s * 1000 / n, t[n / 2] * 1000, t[n * 95 / 100] * 1000, t[n - 1] * 1000);
+}
+
+// Read a camera path: seven values per frame giving the view rotation in
+// degrees, the view position, and the vertical field of view in degrees, as
+// recorded by hipviz -R.
+
+static double *read_path(const char *filename, size_t *n)
+{
+    double *p = NULL;
+    double *q;
+    double  f[7];
+    size_t  c = 0;
+    FILE   *fp;
+
+    if ((fp = fopen(filename, "r")))
+    {
+        while (fscanf(fp, "%lf %lf %lf %lf %lf %lf %lf", f + 0, f + 1, f + 2,
+                                                         f + 3, f + 4, f + 5,
+                                                         f + 6) == 7)
+            if ((q = (double *) realloc(p, (c + 1) * sizeof (f))))
+            {
+                memcpy(q + c * 7, f, sizeof (f));
+                p = q;
+                c++;
+            }
+        fclose(fp);
+    }
+    *n = c;
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+
+static float view_mag;
+
+static int view_fn(const star *s)
+{
+    return s->mag[1] <= view_mag;
+}
+
+static hippo_list *at_list;
+static const star *at_data;
+
+// Gather each leaf found by a rebased query. The staging buffer receives the
+// stars in their leaf frames, so the leaf center p is not needed.
+
+static void seek_at(const star *v, uint32_t c, const double *p)
+{
+    (void) p;
+
+    hippo_list_append(at_list, (uint32_t) (v - at_data), c);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *p = NULL;
+    float       a = 16.0f / 9.0f;
+    float       e = 0;
+    int         k = 0;
+    int         w = 0;
+    float       z[6] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF,
+                          HUGE_VALF,  HUGE_VALF,  HUGE_VALF };
+    int         y = 0;
+    int         t = 0;
+
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt(argc, argv, "a:ck:p:tv:z:")) != -1)
+
+        switch (c)
+        {
+            case 'a': e = (float) strtod(optarg, 0); break;
+            case 'c': k = 1; break;
+            case 'k': a = (float) strtod(optarg, 0); break;
+            case 'p': p = optarg; break;
+            case 't': t = 1; break;
+            case 'v': w = 1; view_mag = (float) strtod(optarg, 0); break;
+            case 'z': y = 1; z[3]     = (float) strtod(optarg, 0); break;
+        }
+
+    if (p && optind < argc)
+    {
+        hippo       *H;
+        hippo       *R;
+        hippo       *V;
+        hippo_cut   *K = NULL;
+        hippo_async *A = NULL;
+        hippo_list   L = { NULL, NULL, 0, 0 };
+        double      *f;
+        size_t       n;
+
+        if ((f = read_path(p, &n)) && n && (H = hippo_read(argv[optind])))
+        {
+            // Query a view of the stars no fainter than the given magnitude,
+            // if requested. The view lists the stars of its parent R.
+
+            R = H;
+
+            if (w && (V = hippo_view(R, view_fn)))
+                H = V;
+
+            double *tc = (double *) calloc(n, sizeof (double));
+            double *td = (double *) calloc(n, sizeof (double));
+            star   *S  = (star   *) malloc(hippo_size(H) * sizeof (star));
+
+            if (!hippo_rebased(H))
+            {
+                if (k) K = hippo_cut_create(H);
+                if (e) A = hippo_async_create(H, e);
+            }
+
+            at_list = &L;
+            at_data = hippo_data(H);
+
+            printf("frame\tcull\tdraw\tranges\tstars\n");
+
+            for (size_t i = 0; tc && td && S && i < n; i++)
+            {
+                const double *q = f + i * 7;
+                const double  o[3] = { -q[3], -q[4], -q[5] };
+
+                float P[16], M[16], PM[16], v[24];
+                uint32_t s = 0;
+
+                const hippo_list *D = &L;
+
+                // Cull with the camera of hipviz, which views Tycho-2 from
+                // the origin, leaves the translation to the query for a
+                // rebased catalog, and widens the field of view when the
+                // query lags by a frame.
+
+                camera_projection(P, A ? camera_lag((float) q[6])
+                                       : (float) q[6], a);
+                camera_view(M, (float) q[0], (float) q[1],
+                            camera_moves(t, hippo_rebased(H)) ? q + 3 : NULL);
+
+                camera_mult(PM, P, M);
+                hippo_view_bound(v, PM);
+
+                double t0 = now();
+
+                if (hippo_rebased(H))
+                {
+                    L.c = 0;
+                    hippo_seek_at(H, o, v, 6, seek_at);
+                }
+                else if (A)
+                {
+                    if ((D = hippo_async_seek(A, v, 6)) == NULL)
+                        D = &L;
+                }
+                else if (K)
+                {
+                    hippo_cut_update(K, v, 6, NULL, NULL);
+                    hippo_cut_list  (K, &L);
+                }
+                else if (y)
+                    hippo_seek_list_zone(H, v, 6, z, &L);
+                else
+                    hippo_seek_list(H, v, 6, &L);
+
+                double t1 = now();
+
+                for (uint32_t j = 0; j < D->c; j++)
+                {
+                    memcpy(S + s, hippo_data(H) + D->first[j],
+                                  D->count[j] * sizeof (star));
+                    s += D->count[j];
+                }
+
+                double t2 = now();
+
+                tc[i] = t1 - t0;
+                td[i] = t2 - t1;
+
+                printf("%zu\t%.3f\t%.3f\t%u\t%u\n", i, tc[i] * 1000,
+                                                      td[i] * 1000, D->c, s);
+            }
+
+            if (tc && td && S)
+            {
+                report("cull", tc, n);
+                report("draw", td, n);
+            }
+
+            // The async query owns the lists it returns.
+
+            hippo_async_free(A);
+            hippo_list_free(&L);
+
+            hippo_cut_free(K);
+            if (H != R)
+                hippo_free(H);
+            hippo_free(R);
+            free(S);
+            free(td);
+            free(tc);
+            free(f);
+            return 0;
+        }
+        free(f);
+    }
+
+    fprintf(stderr, "Usage: %s [-a distance] [-c] [-k aspect] [-t] [-v magnitude] "
+                              "[-z magnitude] -p path.txt catalog.riff\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,350 @@
+// Copyright (C) 2005-2013 Robert Kooima
+//
+// This file is part of Hippo.
+//
+// Hippo is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// Hippo is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along
+// with Hippo. If not, see <http://www.gnu.org/licenses/>.
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include "hippo.h"
+#include "hippo.hpp"
+#include "camera.h"
+
+// Check the derived queries of a catalog against hippo_seek. Each query is
+// run on the same volumes, a series of cubes and view frusta, and must give
+// the same stars in the same order. With -g, instead write a synthetic
+// Hipparcos input from which hipgen may build a catalog to check.
+
+typedef std::vector<uint32_t> indices;
+
+//-----------------------------------------------------------------------------
+
+// Write n random records in the Hipparcos format, giving only the fields read
+// by hippo_read_hip: right ascension, declination, parallax, B, and V.
+
+static int generate(const char *filename, int n)
+{
+    FILE *fp;
+
+    if ((fp = fopen(filename, "w")))
+    {
+        srand(1);
+
+        for (int i = 0; i < n; i++)
+        {
+            char rec[261];
+            char fld[32];
+
+            const double r = 360.0 * rand() / RAND_MAX;
+            const double d = 180.0 * rand() / RAND_MAX - 90.0;
+            const double q = 300.0 * rand() / RAND_MAX + 0.5;
+            const double v =  13.0 * rand() / RAND_MAX - 1.0;
+            const double b = v + 2.3 * rand() / RAND_MAX - 0.3;
+
+            memset(rec, ' ', 260);
+            rec[260] = 0;
+
+            snprintf(fld, sizeof (fld), "%12.8f", r); memcpy(rec +  51, fld, 12);
+            snprintf(fld, sizeof (fld), "%12.8f", d); memcpy(rec +  64, fld, 12);
+            snprintf(fld, sizeof (fld), "%7.2f",  q); memcpy(rec +  79, fld,  7);
+            snprintf(fld, sizeof (fld), "%6.3f",  b); memcpy(rec + 217, fld,  6);
+            snprintf(fld, sizeof (fld), "%6.3f",  v); memcpy(rec + 230, fld,  6);
+
+            fprintf(fp, "%s\n", rec);
+        }
+        return (fclose(fp) == 0);
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+// Compute in v the planes of the k-th test volume: alternately a cube and a
+// view frustum, of varying size, position, and orientation.
+
+static void volume(float *v, int k)
+{
+    const float p[3] = { 2000.0f * rand() / RAND_MAX - 1000.0f,
+                         2000.0f * rand() / RAND_MAX - 1000.0f,
+                         2000.0f * rand() / RAND_MAX - 1000.0f };
+    if (k & 1)
+    {
+        const double o[3] = { p[0], p[1], p[2] };
+
+        float P[16], M[16], PM[16];
+
+        camera_projection(P, 10.0f + 80.0f * rand() / RAND_MAX, 16.0f / 9.0f);
+        camera_view(M, 180.0f * rand() / RAND_MAX - 90.0f,
+                       360.0f * rand() / RAND_MAX, o);
+        camera_mult(PM, P, M);
+        hippo_view_bound(v, PM);
+    }
+    else hippo_cube_bound(v, p, 10.0f + 800.0f * rand() / RAND_MAX);
+}
+
+// Gather the indices of the stars listed by hippo_seek, and the first index
+// and count of each range visited.
+
+static const star *seek_data;
+static indices    *seek_index;
+static indices    *seek_range;
+
+static void seek_fn(const star *s, uint32_t c)
+{
+    seek_range->push_back(uint32_t(s - seek_data));
+    seek_range->push_back(c);
+
+    for (uint32_t i = 0; i < c; i++)
+        seek_index->push_back(uint32_t(s - seek_data) + i);
+}
+
+static void seek(const hippo *H, const float *v, indices& I, indices& R)
+{
+    seek_data  = hippo_data(H);
+    seek_index = &I;
+    seek_range = &R;
+
+    I.clear();
+    R.clear();
+    hippo_seek(H, v, 6, seek_fn);
+}
+
+// Expand list L into the indices of the stars it lists.
+
+static void expand(const hippo_list *L, indices& I)
+{
+    I.clear();
+
+    for (uint32_t i = 0; i < L->c; i++)
+        for (int      j = 0; j < L->count[i]; j++)
+            I.push_back(L->first[i] + j);
+}
+
+// Report a mismatch between query q and hippo_seek on the k-th volume.
+
+static int differ(const char *name, const char *q, int k,
+                  const indices& A, const indices& B)
+{
+    if (A == B)
+        return 0;
+
+    fprintf(stderr, "%s: %s differs from hippo_seek on volume %d: "
+                    "%zu stars, expected %zu\n", name, q, k, B.size(), A.size());
+    return 1;
+}
+
+// Return nonzero if the stars listed by L within buffer D are those of H at
+// indices A, in order, with some omitted if o is nonzero. The ranges of a
+// cache lie within its buffer rather than the catalog, so compare the stars
+// themselves.
+
+static int same(const hippo *H, const indices& A, const star *D,
+                const hippo_list *L, int o)
+{
+    const star *S = hippo_data(H);
+    size_t      k = 0;
+
+    for (uint32_t i = 0; i < L->c; i++)
+        for (int      j = 0; j < L->count[i]; j++, k++)
+        {
+            while (o && k < A.size() && memcmp(S + A[k], D + L->first[i] + j,
+                                               sizeof (star)))
+                k++;
+
+            if (k == A.size() || memcmp(S + A[k], D + L->first[i] + j,
+                                        sizeof (star)))
+                return 0;
+        }
+
+    return (o || k == A.size());
+}
+
+//-----------------------------------------------------------------------------
+
+// Check each query of catalog H on n volumes. Return the number of failures.
+
+static int check(const char *name, const hippo *H, int n)
+{
+    hippo_list   L = { NULL, NULL, 0, 0 };
+    indices      A;
+    indices      B;
+    indices      P;
+    indices      R;
+    int          f = 0;
+
+    // The cache holds every star, so that none is omitted from an empty one.
+
+    const uint32_t m = hippo_size(H);
+
+    hippo_cache *C = hippo_cache_create(H, m);
+    star        *D = (star *) malloc(m * sizeof (star));
+
+    if (C == NULL || D == NULL)
+    {
+        fprintf(stderr, "%s: failed to create cache\n", name);
+        f++;
+    }
+
+    hippo_async *Q = hippo_async_create(H, 0.0f);
+
+    if (Q == NULL)
+    {
+        fprintf(stderr, "%s: failed to create async query\n", name);
+        f++;
+    }
+
+    srand(2);
+
+    for (int k = 0; k < n; k++)
+    {
+        float v[24];
+
+        volume(v, k);
+        seek(H, v, A, R);
+
+        // hippo_seek_list gives the same ranges, coalesced.
+
+        if (hippo_seek_list(H, v, 6, &L))
+            expand(&L, B);
+        else
+            B.clear();
+
+        f += differ(name, "hippo_seek_list", k, A, B);
+
+        // hip::seek visits the same ranges, specialized for six planes.
+
+        const star *S = hippo_data(H);
+
+        B.clear();
+        hip::seek<6>(H, v, [&](const star *s, uint32_t c) {
+            B.push_back(uint32_t(s - S));
+            B.push_back(c);
+        });
+
+        if (B != R)
+        {
+            fprintf(stderr, "%s: hip::seek<6> differs from hippo_seek on volume "
+                            "%d: %zu ranges, expected %zu\n", name, k,
+                            B.size() / 2, R.size() / 2);
+            f++;
+        }
+
+        // hippo_cache_seek gives the same stars, copied into its buffer. It
+        // omits those it cannot make resident without evicting others of the
+        // same frame, but only while its buffer holds those of past frames.
+
+        if (C && D)
+        {
+            const int o = k % 4;
+
+            if (o == 0)
+                hippo_cache_reset(C);
+
+            hippo_cache_begin(C, D);
+            int s = hippo_cache_seek(C, v, 6, &L);
+            hippo_cache_end(C);
+
+            if (s == 0 || same(H, A, D, &L, o) == 0)
+            {
+                fprintf(stderr, "%s: hippo_cache_seek differs from hippo_seek "
+                                "on volume %d\n", name, k);
+                f++;
+            }
+        }
+
+        // hippo_async_seek gives the stars of the previous volume, or of this
+        // one on the first call.
+
+        if (Q)
+        {
+            if (const hippo_list *F = hippo_async_seek(Q, v, 6))
+                expand(F, B);
+            else
+                B.clear();
+
+            f += differ(name, "hippo_async_seek", k, k ? P : A, B);
+        }
+        P.swap(A);
+    }
+
+    hippo_async_free(Q);
+    hippo_cache_free(C);
+    hippo_list_free(&L);
+    free(D);
+    return f;
+}
+
+static int view_fn(const star *s)
+{
+    return s->mag[1] <= 6.0f;
+}
+
+int main(int argc, char *argv[])
+{
+    int g = 0;
+    int n = 200;
+
+    int c;
+
+    opterr = 0;
+
+    while ((c = getopt(argc, argv, "g:n:")) != -1)
+
+        switch (c)
+        {
+            case 'g': g = (int) strtol(optarg, 0, 0); break;
+            case 'n': n = (int) strtol(optarg, 0, 0); break;
+        }
+
+    if (optind < argc && g)
+        return generate(argv[optind], g) ? 0 : 1;
+
+    if (optind < argc)
+    {
+        hippo *H;
+        hippo *V;
+        int    f = 0;
+
+        if ((H = hippo_read(argv[optind])))
+        {
+            f += check(argv[optind], H, n);
+
+            // Check a view also, as its lists are not contiguous.
+
+            if ((V = hippo_view(H, view_fn)))
+            {
+                f += check("view", V, n);
+                hippo_free(V);
+            }
+            else f++;
+
+            hippo_free(H);
+
+            if (f == 0)
+                printf("%s: %d volumes ok\n", argv[optind], n);
+
+            return f ? 1 : 0;
+        }
+    }
+
+    fprintf(stderr, "Usage: %s [-n volumes] catalog.riff\n"
+                    "       %s -g stars hip_main.dat\n", argv[0], argv[0]);
+    return 1;
+}
@@ -10,27 +10,55 @@ int main(int argc, char *argv[])
     const char *H = NULL;
     const char *T = NULL;
     uint32_t    d =   10;
+    size_t      m =    0;
+    int         a =    1;
+    int         f =    0;
 
     int c;
 
     opterr = 0;
 
-    while ((c = getopt(argc, argv, "H:T:d:")) != -1)
+    while ((c = getopt(argc, argv, "H:T:bd:m:nrzZ")) != -1)
 
         switch (c)
         {
             case 'T': T = optarg; break;
             case 'H': H = optarg; break;
+            case 'b': f |= HIPPO_BRIGHT_LEAF; break;
             case 'd': d = (uint32_t) strtol(optarg, 0, 0); break;
+            case 'm': m = (size_t)   strtol(optarg, 0, 0) << 20; break;
+            case 'n': a = 0; break;
+            case 'r': f |= HIPPO_REBASE;      break;
+            case 'z': f |= HIPPO_MORTON_LEAF; break;
+            case 'Z': f |= HIPPO_MORTON_TREE; break;
         }
 
-    if (optind < argc)
+    // Out-of-core ingestion neither rebases nor reorders.
+
+    if (m && f)
+    {
+        fprintf(stderr, "%s: -m may not be combined with -b, -r, -z, or -Z\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (optind < argc && m)
     {
-        if (T && hippo_write(hippo_read_tyc(T, d), argv[optind])) return 0;
-        if (H && hippo_write(hippo_read_hip(H, d), argv[optind])) return 0;
+        if (T && hippo_make_tyc(T, argv[optind], d, m, a)) return 0;
+        if (H && hippo_make_hip(H, argv[optind], d, m, a)) return 0;
+    }
+    else if (optind < argc)
+    {
+        hippo *C = NULL;
+
+        if (T && C == NULL) C = hippo_read_dat(T, d, f | HIPPO_TYC);
+        if (H && C == NULL) C = hippo_read_dat(H, d, f);
+
+        if (C && hippo_aggregate(C, a) && hippo_write(C, argv[optind]))
+            return 0;
     }
 
-    fprintf(stderr, "Usage: %s [-T tyc2.dat] "
+    fprintf(stderr, "Usage: %s [-b] [-d depth] [-m megabytes] [-n] [-r] [-z] [-Z] [-T tyc2.dat] "
                               "[-H hip_main.dat] output.riff\n", argv[0]);
     return 1;
 }
@@ -19,12 +19,16 @@
 #include <stdint.h>
 #include <assert.h>
 #include <unistd.h>
+#include <string.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <math.h>
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "hippo.h"
 
@@ -32,23 +36,49 @@
 
 #define LY_PER_PC 3.26163344
 #define MAXRECLEN 512
+#define NONE      0xFFFFFFFF
 
 // The node structure represents one node in the binary space partitioning of
-// the star catalog.
+// the star catalog. Its layout is public, for the benefit of hippo.hpp.
 
-struct node
+typedef struct hippo_node node;
+
+// The page structure tracks the residency of the subtrees rooted at depth k of
+// a mapped catalog, with c of at most n of them resident at once. Resident
+// tiles sit in a ring swept by a clock hand. Each use of a tile sets its used
+// flag, and an eviction clears the flags it passes, evicting the first tile
+// found unused since the hand last passed it. Uses of resident tiles take no
+// lock. Loads and evictions are serialized by the mutex.
+
+struct page
 {
-    float    bound[6];
-    uint32_t star0;
-    uint32_t starc;
-    uint32_t nodeL;
-    uint32_t nodeR;
+    pthread_mutex_t mutex;
+
+    uint32_t  k;
+    uint32_t  n;
+    uint32_t  c;
+    uint32_t  hand;
+    uint32_t *ring;
+    uint32_t *tile;
+    uint8_t  *used;
+    uint8_t  *live;
 };
 
-typedef struct node node;
+typedef struct page page;
 
 // The hippo structure represents an open catalog with its stars, BSP nodes,
-// and the pointer and length of its mapped file, if any.
+// optional node aggregates, optional node zones, optional node centers of a
+// rebased catalog, and the pointer and length of its RIFF image. The image is
+// either a mapped file or a single allocation laid out exactly as one, and the
+// chunks locate within it. Flags note what the catalog owns: aggregates
+// computed after mapping, an open file, a mapping, or an allocated image. A
+// view gives the parent whose stars it shares, and its internal nodes span
+// stars it does not select.
+
+#define OWN_AGGR  1
+#define OWN_FILE  2
+#define OWN_MAP   4
+#define OWN_IMAGE 8
 
 struct hippo
 {
@@ -56,10 +86,18 @@ struct hippo
     uint32_t starc;
     node    *nodes;
     uint32_t nodec;
+    aggr    *aggrs;
+    float   *zones;
+    void    *cents;
 
+    int      own;
     int      fd;
     void    *ptr;
     size_t   len;
+
+    page    *pages;
+
+    const hippo *parent;
 };
 
 //-----------------------------------------------------------------------------
@@ -74,36 +112,146 @@ static inline float max(float a, float b)
     return (a > b) ? a : b;
 }
 
-// Star-sorting callbacks. Compare the X, Y, or Z coordinates of two stars.
+// Stars lie z bytes apart, allowing each to carry data of its own along with
+// it during the build.
+
+#define STAR(S, z, s) ((const star *) ((const char *) (S) + (size_t) (s) * (z)))
+
+// Return float f as an unsigned key that sorts as the float does: flip the
+// sign bit of a positive value and all bits of a negative one.
+
+static inline uint32_t float_key(float f)
+{
+    uint32_t u;
+
+    memcpy(&u, &f, sizeof (uint32_t));
+
+    return (u & 0x80000000) ? ~u : (u | 0x80000000);
+}
+
+// Return the i-coordinate of star s as an unsigned key.
 
-static int star_cmp0(const void *a, const void *b)
+static inline uint32_t axis_key(const star *s, uint32_t i)
 {
-    return (((const star *) a)->pos[0] <
-            ((const star *) b)->pos[0]) ? -1 : +1;
+    return float_key(s->pos[i]);
 }
 
-static int star_cmp1(const void *a, const void *b)
+// Swap the z-byte stars at p and q. Plain stars are by far the most common,
+// and copies of a constant size are inlined.
+
+static inline void star_swap(char *p, char *q, size_t z)
 {
-    return (((const star *) a)->pos[1] <
-            ((const star *) b)->pos[1]) ? -1 : +1;
+    char t[64];
+
+    assert(z <= sizeof (t));
+
+    if (z == sizeof (star))
+    {
+        memcpy(t, p, sizeof (star));
+        memcpy(p, q, sizeof (star));
+        memcpy(q, t, sizeof (star));
+    }
+    else
+    {
+        memcpy(t, p, z);
+        memcpy(p, q, z);
+        memcpy(q, t, z);
+    }
 }
 
-static int star_cmp2(const void *a, const void *b)
+// Return byte k of the i-key of the z-byte star s of S.
+
+#define DIGIT(S, z, s, i, k) ((axis_key(STAR(S, z, s), i) >> (k)) & 0xFF)
+
+// Rearrange stars s0 through s1 so that those whose byte k of their i-key is
+// less than b (or, if e, less than or equal to b) precede all others. Return
+// the index of the first of the others. As does divide, sweep the range from
+// either end, swapping only stars on the wrong side.
+
+static uint32_t divide_key(void *S, size_t z, uint32_t s0, uint32_t s1,
+                           uint32_t i, int k, uint32_t b, int e)
 {
-    return (((const star *) a)->pos[2] <
-            ((const star *) b)->pos[2]) ? -1 : +1;
+    uint32_t a = s0;
+    uint32_t c = s1;
+
+    for (;;)
+    {
+        while (a < c && (DIGIT(S, z, a,     i, k) < b || (e && DIGIT(S, z, a,     i, k) == b))) a++;
+        while (a < c && (DIGIT(S, z, c - 1, i, k) > b || (!e && DIGIT(S, z, c - 1, i, k) == b))) c--;
+
+        if (a < c)
+            star_swap((char *) S + (size_t) a * z, (char *) S + (size_t) (c - 1) * z, z);
+        else
+            return a;
+    }
 }
 
-int (*star_cmp[3])(const void *, const void *) = {
-    star_cmp0,
-    star_cmp1,
-    star_cmp2
-};
+// Rearrange stars s0 through s1 such that none preceding sm has i-coordinate
+// greater than that of sm and none following has one less. Each round counts
+// the stars of the range by one byte of their key, most significant first,
+// finds the byte value b of the star destined for sm, and partitions the range
+// in place into those less than b, equal to b, and greater than b, before
+// continuing within the middle. Thus each round is linear and sequential, and
+// no more than four rounds are needed.
+
+static void select_axis(void *S, size_t z, uint32_t s0, uint32_t s1,
+                        uint32_t sm, uint32_t i)
+{
+    uint32_t h[256];
 
-// Recursively sort the list of stars into a binary-space-partitioning.
+    for (int k = 24; k >= 0 && s1 - s0 > 1; k -= 8)
+    {
+        uint32_t a = s0;
+        uint32_t b;
+
+        // Find the byte value b of the star destined for sm.
+
+        memset(h, 0, sizeof (h));
+
+        for (uint32_t s = s0; s < s1; s++)
+            h[DIGIT(S, z, s, i, k)]++;
+
+        for (b = 0; a + h[b] <= sm; b++)
+            a += h[b];
+
+        // Partition the range about b, unless all stars share it.
+
+        if (h[b] < s1 - s0)
+        {
+            a  = divide_key(S, z, s0, s1, i, k, b, 0);
+            s1 = divide_key(S, z, a,  s1, i, k, b, 1);
+            s0 = a;
+        }
+    }
+}
+
+// Find the bound b of stars s0 through s1.
+
+static void star_bound(float *b, const void *S, size_t z, uint32_t s0, uint32_t s1)
+{
+    b[0] = b[3] = STAR(S, z, s0)->pos[0];
+    b[1] = b[4] = STAR(S, z, s0)->pos[1];
+    b[2] = b[5] = STAR(S, z, s0)->pos[2];
+
+    for (uint32_t s = s0; s < s1; s++)
+    {
+        const float *p = STAR(S, z, s)->pos;
+
+        b[0] = min(b[0], p[0]);
+        b[1] = min(b[1], p[1]);
+        b[2] = min(b[2], p[2]);
+        b[3] = max(b[3], p[0]);
+        b[4] = max(b[4], p[1]);
+        b[5] = max(b[5], p[2]);
+    }
+}
+
+// Recursively partition the list of stars into a binary-space-partitioning.
+// Axis i is 3 if the stars are already in Morton order, in which case each
+// node is split at its middle star with no rearrangement.
 
 static int mknode(node *N, uint32_t n0, uint32_t n1, uint32_t d,
-                  star *S, uint32_t s0, uint32_t s1, uint32_t i)
+                  void *S, size_t z, uint32_t s0, uint32_t s1, uint32_t i)
 {
     // This node contains stars s0 through s1.
 
@@ -116,9 +264,10 @@ static int mknode(node *N, uint32_t n0, uint32_t n1, uint32_t d,
     {
         uint32_t sm = (s1 + s0) / 2;
 
-        // Sort these stars along the i-axis.
+        // Partition these stars at the middle along the i-axis.
 
-        qsort(S + s0, s1 - s0, sizeof (struct star), star_cmp[i]);
+        if (i < 3)
+            select_axis(S, z, s0, s1, sm, i);
 
         // Create a BSP split at the i-position of the middle star.
 
@@ -127,8 +276,8 @@ static int mknode(node *N, uint32_t n0, uint32_t n1, uint32_t d,
 
         // Create new nodes, each containing half of the stars.
 
-        n1 = mknode(N, N[n0].nodeL, n1, d - 1, S, s0, sm, (i + 1) % 3);
-        n1 = mknode(N, N[n0].nodeR, n1, d - 1, S, sm, s1, (i + 1) % 3);
+        n1 = mknode(N, N[n0].nodeL, n1, d - 1, S, z, s0, sm, (i < 3) ? (i + 1) % 3 : i);
+        n1 = mknode(N, N[n0].nodeR, n1, d - 1, S, z, sm, s1, (i < 3) ? (i + 1) % 3 : i);
 
         // Find the node bound.
 
@@ -141,357 +290,5187 @@ static int mknode(node *N, uint32_t n0, uint32_t n1, uint32_t d,
     }
     else
     {
-        // Find the node bound.
+        N[n0].nodeL = 0;
+        N[n0].nodeR = 0;
 
-        N[n0].bound[0] = N[n0].bound[3] = S[s0].pos[0];
-        N[n0].bound[1] = N[n0].bound[4] = S[s0].pos[1];
-        N[n0].bound[2] = N[n0].bound[5] = S[s0].pos[2];
+        // Find the node bound.
 
-        for (uint32_t s = s0; s < s1; s++)
-        {
-            N[n0].bound[0] = min(N[n0].bound[0], S[s].pos[0]);
-            N[n0].bound[1] = min(N[n0].bound[1], S[s].pos[1]);
-            N[n0].bound[2] = min(N[n0].bound[2], S[s].pos[2]);
-            N[n0].bound[3] = max(N[n0].bound[3], S[s].pos[0]);
-            N[n0].bound[4] = max(N[n0].bound[4], S[s].pos[1]);
-            N[n0].bound[5] = max(N[n0].bound[5], S[s].pos[2]);
-        }
+        star_bound(N[n0].bound, S, z, s0, s1);
     }
     return n1;
 }
 
-//-----------------------------------------------------------------------------
+// Spread the low 21 bits of x to every third bit.
 
-static inline double rad(double d)
+static inline uint64_t spread3(uint64_t x)
 {
-    return d * 0.017453292519943295;
+    x &= 0x00000000001FFFFF;
+    x = (x | (x << 32)) & 0x001F00000000FFFF;
+    x = (x | (x << 16)) & 0x001F0000FF0000FF;
+    x = (x | (x <<  8)) & 0x100F00F00F00F00F;
+    x = (x | (x <<  4)) & 0x10C30C30C30C30C3;
+    x = (x | (x <<  2)) & 0x1249249249249249;
+    return x;
 }
 
-// Parse the given line as a Hipparcos record and populate the star structure.
+// Return the 63-bit Morton code of position p quantized within bound b.
 
-static int parse_hip(star *s, const char *rec)
+static inline uint64_t morton(const float *p, const float *b)
 {
-    double r;  // Right ascension
-    double d;  // Declination
-    double p;  // Parallax
-    double b;  // B magnitude
-    double v;  // V magnitude
+    uint64_t c = 0;
 
-    if (sscanf(rec +  51, "%lf", &r) == 1 &&
-        sscanf(rec +  64, "%lf", &d) == 1 &&
-        sscanf(rec +  79, "%lf", &p) == 1 &&
-        sscanf(rec + 217, "%lf", &b) == 1 &&
-        sscanf(rec + 230, "%lf", &v) == 1 && p > 0.0)
+    for (int i = 0; i < 3; i++)
     {
-        s->pos[0] = (float) (sin(rad(r)) * cos(rad(d)) * 3261.63344 / fabs(p));
-        s->pos[1] = (float) (              sin(rad(d)) * 3261.63344 / fabs(p));
-        s->pos[2] = (float) (cos(rad(r)) * cos(rad(d)) * 3261.63344 / fabs(p));
-        s->mag[0] = (float) b;
-        s->mag[1] = (float) v;
+        const double d = (double) b[i + 3] - (double) b[i];
 
-        return 1;
+        if (d > 0)
+            c |= spread3((uint64_t) ((p[i] - b[i]) / d * 2097151.0)) << i;
     }
-    return 0;
+    return c;
 }
 
-// Parse the given line as a Tycho-2 record and populate the star structure.
-// Include only records with both B and V magnitudes, and exclude any record
-// that already appears in the Hipparcos catalog.
+// A sort key gives the Morton code of a star and its index, which breaks ties
+// so that equal codes keep their order.
 
-static int parse_tyc(star *s, const char *rec)
+struct key
 {
-    int    h;  // Hipparcos number
-    double r;  // Right ascension
-    double d;  // Declination
-    double b;  // B magnitude
-    double v;  // V magnitude
-
-    if (sscanf(rec + 142, "%d",  &h) == 0 &&
-        sscanf(rec +  15, "%lf", &r) == 1 &&
-        sscanf(rec +  28, "%lf", &d) == 1 &&
-        sscanf(rec + 110, "%lf", &b) == 1 &&
-        sscanf(rec + 123, "%lf", &v) == 1)
-    {
-        s->pos[0] = (float) (sin(rad(r)) * cos(rad(d)) * 32.6163344);
-        s->pos[1] = (float) (              sin(rad(d)) * 32.6163344);
-        s->pos[2] = (float) (cos(rad(r)) * cos(rad(d)) * 32.6163344);
-        s->mag[0] = (float) b;
-        s->mag[1] = (float) v;
+    uint64_t code;
+    uint32_t index;
+};
 
-        return 1;
-    }
-    return 0;
-}
+typedef struct key key;
 
-// Initialize the star array using the given record parser on the named file.
+// Sort the n keys at k by code, using the n keys at t as scratch, and return
+// whichever holds the result. Each pass distributes the keys by one byte of
+// their code, least significant first, and is stable, so keys given in index
+// order leave in index order among equal codes. Passes over a byte shared by
+// all codes are skipped.
 
-static int parse_dat(hippo *H, const char *filename,
-         int (*parse)(star *s, const char *rec))
+static key *key_sort(key *k, key *t, uint32_t n)
 {
-    FILE *stream;
+    uint32_t h[256];
 
-    if ((stream = fopen(filename, "r")))
+    for (int shift = 0; shift < 64 && n > 0; shift += 8)
     {
-        // Make a pass over the input to determine the number of records.
+        uint32_t a = 0;
+        uint32_t c;
+        key     *x;
 
-        char buf[MAXRECLEN];
-        int  n = 0;
-        star s;
+        memset(h, 0, sizeof (h));
 
-        while (fgets(buf, MAXRECLEN, stream))
-            n += parse(&s, buf);
-
-        // Allocate storage and read all records to it.
+        for (uint32_t j = 0; j < n; j++)
+            h[(k[j].code >> shift) & 0xFF]++;
 
-        rewind(stream);
+        if (h[(k[0].code >> shift) & 0xFF] == n)
+            continue;
 
-        if ((H->stars = (star *) malloc(n * sizeof (star))))
+        for (uint32_t b = 0; b < 256; b++)
         {
-            while (fgets(buf, MAXRECLEN, stream))
-                H->starc += parse(H->stars + H->starc, buf);
+            c    = h[b];
+            h[b] = a;
+            a   += c;
         }
 
-        fclose(stream);
+        for (uint32_t j = 0; j < n; j++)
+            t[h[(k[j].code >> shift) & 0xFF]++] = k[j];
+
+        x = k;
+        k = t;
+        t = x;
     }
-    return H->starc;
+    return k;
 }
 
-//-----------------------------------------------------------------------------
-
-// Read a catalog in Hipparcos format and generate its index.
+// Sort the n keys at k, which give stars s0 onward, and rearrange the stars
+// into the same order. Return 0 on failure.
 
-hippo *hippo_read_hip(const char *filename, uint32_t d)
+static int key_order(void *S, size_t z, uint32_t s0, uint32_t n, key *k)
 {
-    hippo *H;
+    key  *u = (key  *) malloc(n * sizeof (key));
+    char *T = (char *) malloc(n * z);
+    int   stat = 0;
 
-    if ((H = (hippo *) calloc(sizeof (hippo), 1)))
+    if (u && T)
     {
-        if (parse_dat(H, filename, parse_hip) > 0)
-        {
-            if ((H->nodes = (node *) malloc((1 << (d + 1)) * sizeof(node))))
-            {
-                H->nodec = mknode(H->nodes, 0, 1, d, H->stars, 0, H->starc, 0);
-                return H;
-            }
-        }
+        key *r = key_sort(k, u, n);
+
+        for (uint32_t j = 0; j < n; j++)
+            memcpy(T + j * z, STAR(S, z, s0 + r[j].index), z);
+
+        memcpy((char *) S + s0 * z, T, n * z);
+        stat = 1;
     }
-    hippo_free(H);
-    return NULL;
+    free(T);
+    free(u);
+    return stat;
 }
 
-// Read a catalog in Tycho-2 format and generate its index.
+// Sort stars s0 through s1 by the Morton code of their position within bound
+// b. Return 0 on failure.
 
-hippo *hippo_read_tyc(const char *filename, uint32_t d)
+static int morton_sort(void *S, size_t z, uint32_t s0, uint32_t s1, const float *b)
 {
-    hippo *H;
+    const uint32_t n = s1 - s0;
 
-    if ((H = (hippo *) calloc(sizeof (hippo), 1)))
+    key *k = (key *) malloc(n * sizeof (key));
+    int  stat = 0;
+
+    if (k)
     {
-        if (parse_dat(H, filename, parse_tyc) > 0)
+        for (uint32_t j = 0; j < n; j++)
         {
-            if ((H->nodes = (node *) malloc((1 << (d + 1)) * sizeof(node))))
-            {
-                H->nodec = mknode(H->nodes, 0, 1, d, H->stars, 0, H->starc, 0);
-                return H;
-            }
+            k[j].code  = morton(STAR(S, z, s0 + j)->pos, b);
+            k[j].index = j;
         }
+        stat = key_order(S, z, s0, n, k);
     }
-    hippo_free(H);
-    return H;
-}
-
-//-----------------------------------------------------------------------------
-
-// Return a four-character code of the given string.
-
-static uint32_t fourcc(const char *s)
-{
-    return s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24;
+    free(k);
+    return stat;
 }
 
-// Search a RIFF and return a pointer to the chunk with the given FOURCC.
+// Sort stars s0 through s1 by V magnitude, brightest first. Return 0 on
+// failure.
 
-static void *riff_chunk(void *p, uint32_t cc)
+static int bright_sort(void *S, size_t z, uint32_t s0, uint32_t s1)
 {
-    uint32_t *b = (uint32_t *) p;
-
-    if (b[0] == fourcc("RIFF"))
+    const uint32_t n = s1 - s0;
 
-        for (uint32_t *c = b + 2; c < b + 2 + b[1] / 4;
-                                  c = c + 2 + c[1] / 4)
-            if (c[0] == cc)
-                return c;
+    key *k = (key *) malloc(n * sizeof (key));
+    int  stat = 0;
 
-    return 0;
+    if (k)
+    {
+        for (uint32_t j = 0; j < n; j++)
+        {
+            k[j].code  = float_key(STAR(S, z, s0 + j)->mag[1]);
+            k[j].index = j;
+        }
+        stat = key_order(S, z, s0, n, k);
+    }
+    free(k);
+    return stat;
 }
 
-// Read a catalog from the named file in RIFF format.
+// Sort the stars of each leaf of the c nodes N by V magnitude if f includes
+// HIPPO_BRIGHT_LEAF, or else into Morton order within the bound of the leaf.
+// Return 0 on failure.
 
-hippo *hippo_read(const char *filename)
+static int sort_leaves(const node *N, uint32_t c, void *S, size_t z, int f)
 {
-    struct stat st;
-    hippo       *H;
-    uint32_t    *c;
-
-    if ((H = (hippo *) calloc(sizeof (hippo), 1)))
-    {
-        if ((H->fd = open(filename, O_RDONLY)) != -1)
+    for (uint32_t n = 0; n < c; n++)
+        if (N[n].nodeL == 0 && N[n].starc > 1)
         {
-            if ((fstat(H->fd, &st)) != -1)
-            {
-                H->ptr =  mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, H->fd, 0);
-                H->len = (size_t) st.st_size;
-
-                if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("STAR"))))
-                {
-                    H->stars =   (star *) (c + 2);
-                    H->starc = (uint32_t) (c[1] / sizeof (star));
-                }
+            const uint32_t s0 = N[n].star0;
+            const uint32_t s1 = N[n].star0 + N[n].starc;
 
-                if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("NODE"))))
-                {
-                    H->nodes =   (node *) (c + 2);
-                    H->nodec = (uint32_t) (c[1] / sizeof (node));
-                }
-                return H;
-            }
+            if ((f & HIPPO_BRIGHT_LEAF) ? bright_sort(S, z, s0, s1) == 0
+                                        : morton_sort(S, z, s0, s1, N[n].bound) == 0)
+                return 0;
         }
-    }
-    hippo_free(H);
-    return NULL;
+    return 1;
 }
 
-// Release all resources held by this catalog.
+// Return in o the center of node n, given the double-precision node centers C
+// of a rebased catalog, or zero if C is NULL. Centers are copied, as they need
+// not be aligned within a mapped file.
 
-void hippo_free(hippo *H)
+static void node_center(const void *C, uint32_t n, double *o)
 {
-    if (H)
-    {
-        if (H->fd)
-        {
-            if (H->ptr) munmap(H->ptr, H->len);
-            close(H->fd);
-        }
-        else
-        {
-            if (H->nodes) free(H->nodes);
-            if (H->stars) free(H->stars);
-        }
-        free(H);
-    }
+    if (C)
+        memcpy(o, (const char *) C + n * 3 * sizeof (double), 3 * sizeof (double));
+    else
+        o[0] = o[1] = o[2] = 0.0;
 }
 
-// Write the catalog contents to the named file in RIFF format.
+// Return in o the center of node n in single precision, as an offset that
+// restores the star positions of a rebased leaf to the frame of the catalog.
 
-int hippo_write(hippo *H, const char *filename)
+static void node_offset(const void *C, uint32_t n, float *o)
 {
-    int fd   = 0;
-    int stat = 0;
+    double c[3];
 
-    assert(sizeof (float) == 4);
+    node_center(C, n, c);
 
-    if (H && (fd = open(filename, O_WRONLY | O_CREAT, 0666)) != -1)
-    {
-        uint32_t stars = (uint32_t) (H->starc * sizeof (star));
-        uint32_t nodes = (uint32_t) (H->nodec * sizeof (node));
-        uint32_t riffs = stars + nodes + 16;
+    o[0] = (float) c[0];
+    o[1] = (float) c[1];
+    o[2] = (float) c[2];
+}
 
-        stat = (write(fd, "RIFF",   4) == 4
-             && write(fd, &riffs,   4) == 4
-             && write(fd, "STAR",   4) == 4
-             && write(fd, &stars,   4) == 4
-             && write(fd, H->stars, (size_t) stars) == (ssize_t) stars
-             && write(fd, "NODE",   4) == 4
-             && write(fd, &nodes,   4) == 4
-             && write(fd, H->nodes, (size_t) nodes) == (ssize_t) nodes);
+// Copy star s to t, offset by o.
 
-        close(fd);
-    }
-    return stat;
+static inline const star *star_at(star *t, const star *s, const float *o)
+{
+    t->pos[0] = s->pos[0] + o[0];
+    t->pos[1] = s->pos[1] + o[1];
+    t->pos[2] = s->pos[2] + o[2];
+    t->mag[0] = s->mag[0];
+    t->mag[1] = s->mag[1];
+    return t;
 }
 
 //-----------------------------------------------------------------------------
 
-// Return the number of bounding box corners lying in front of plane v.
+// Return the V-band luminosity of a star, as the flux it would present at a
+// distance of 10 parsecs relative to that of a zero-magnitude star.
 
-static int plane_test(const float *b, const float *v)
+static inline double luminosity(const star *s)
 {
-    const float k00 = b[0] * v[0];
-    const float k11 = b[1] * v[1];
-    const float k22 = b[2] * v[2];
-    const float k30 = b[3] * v[0];
-    const float k41 = b[4] * v[1];
-    const float k52 = b[5] * v[2];
+    double d = sqrt(s->pos[0] * s->pos[0] +
+                    s->pos[1] * s->pos[1] +
+                    s->pos[2] * s->pos[2]) / (10.0 * LY_PER_PC);
 
-    return (k00 + k11 + k22 + v[3] > 0 ? 1 : 0)
-         + (k00 + k11 + k52 + v[3] > 0 ? 1 : 0)
-         + (k00 + k41 + k22 + v[3] > 0 ? 1 : 0)
-         + (k00 + k41 + k52 + v[3] > 0 ? 1 : 0)
-         + (k30 + k11 + k22 + v[3] > 0 ? 1 : 0)
-         + (k30 + k11 + k52 + v[3] > 0 ? 1 : 0)
-         + (k30 + k41 + k22 + v[3] > 0 ? 1 : 0)
-         + (k30 + k41 + k52 + v[3] > 0 ? 1 : 0);
+    return pow(10.0, -0.4 * s->mag[1]) * d * d;
 }
 
-// Determine whether an axis-aligned bounding box b is outside-of, inside-of,
-// or split-by the set of c planes at v.
+// Initialize aggregate a to represent star s alone.
 
-static int bound_test(const float *b, const float *v, int c)
+static void aggr_star(aggr *a, const star *s)
 {
-    int n, m = 0;
+    a->pos[0] = s->pos[0];
+    a->pos[1] = s->pos[1];
+    a->pos[2] = s->pos[2];
+    a->lum    = (float) luminosity(s);
+    a->bv     = s->mag[0] - s->mag[1];
+    a->flux   = (float) pow(10.0, -0.4 * s->mag[1]);
+    a->vmin   = s->mag[1];
+    a->vmax   = s->mag[1];
+    a->count  = 1;
+}
 
-    // If the box is entirely behind one of the planes, return -1.
+// Merge aggregate b into aggregate a. An aggregate with a count of zero is
+// empty, regardless of its other values. The centroid is weighted by
+// luminosity and the color by apparent flux, as the eye would blend them.
 
-    for (int i = 0; i < c; i++)
-        if ((n = plane_test(b, v + i * 4)) == 0)
-            return -1;
-        else
-            m += n;
+static void aggr_merge(aggr *a, const aggr *b)
+{
+    if (b->count == 0)
+        return;
 
-    // If the box is entirely in front of all planes, return +1.
+    if (a->count == 0)
+    {
+        *a = *b;
+        return;
+    }
 
-    return (m == c * 8) ? 1 : 0;
+    if (a->lum + b->lum > 0)
+    {
+        const float k = b->lum / (a->lum + b->lum);
+
+        a->pos[0] += (b->pos[0] - a->pos[0]) * k;
+        a->pos[1] += (b->pos[1] - a->pos[1]) * k;
+        a->pos[2] += (b->pos[2] - a->pos[2]) * k;
+    }
+    if (a->flux + b->flux > 0)
+    {
+        const float k = b->flux / (a->flux + b->flux);
+
+        a->bv += (b->bv - a->bv) * k;
+    }
+    a->lum   += b->lum;
+    a->flux  += b->flux;
+    a->vmin   = min(a->vmin, b->vmin);
+    a->vmax   = max(a->vmax, b->vmax);
+    a->count += b->count;
 }
 
-// Traverse the node hierarchy. Call fn with each list of stars that falls
-// within the set of c planes at v.
+// Compute the aggregate photometry of each node, given the node centers C of
+// a rebased catalog, if any. Children always follow their parents in the node
+// array, so a reverse pass visits children first.
 
-static void traverse(const hippo *H,
-                     const float *v, int c, hippo_seek_fn fn, uint32_t n, int i)
+static void mkaggr(aggr *A, const node *N, uint32_t c, const star *S,
+                   const void *C)
 {
-    int r = bound_test(H->nodes[n].bound, v, c);
+    aggr  t;
+    star  u;
+    float o[3];
 
-    if (r >= 0)
+    for (uint32_t n = c; n-- > 0; )
     {
-        if (r > 0 || H->nodes[n].nodeL == 0 || H->nodes[n].nodeR == 0)
-            fn(H->stars + H->nodes[n].star0, H->nodes[n].starc);
+        memset(A + n, 0, sizeof (aggr));
+
+        if (N[n].nodeL && N[n].nodeR)
+        {
+            aggr_merge(A + n, A + N[n].nodeL);
+            aggr_merge(A + n, A + N[n].nodeR);
+        }
         else
         {
-            traverse(H, v, c, fn, H->nodes[n].nodeL, (i + 1) % 3);
-            traverse(H, v, c, fn, H->nodes[n].nodeR, (i + 1) % 3);
+            node_offset(C, n, o);
+
+            for (uint32_t s = N[n].star0; s < N[n].star0 + N[n].starc; s++)
+            {
+                aggr_star (&t, star_at(&u, S + s, o));
+                aggr_merge(A + n, &t);
+            }
         }
     }
 }
 
-// Call fn with each list of stars that falls within the set of c planes at v.
+// Compute the aggregate photometry of each node of the catalog, if it does
+// not already have it, or discard it if a is zero.
 
-void hippo_seek(const hippo *H, const float *v, int c, hippo_seek_fn fn)
+int hippo_aggregate(hippo *H, int a)
 {
-    traverse(H, v, c, fn, 0, 0);
-}
+    if (a && H->aggrs == NULL)
+    {
+        if ((H->aggrs = (aggr *) malloc(H->nodec * sizeof (aggr))) == NULL)
+            return 0;
 
-// Return a pointer to the array of stars.
+        mkaggr(H->aggrs, H->nodes, H->nodec, H->stars, H->cents);
+        H->own |= OWN_AGGR;
+    }
+    if (a == 0)
+    {
+        if (H->own & OWN_AGGR)
+            free(H->aggrs);
 
-const star *hippo_data(const hippo *H)
-{
-    return H->stars;
+        H->own  &= ~OWN_AGGR;
+        H->aggrs = NULL;
+    }
+    return 1;
 }
 
-// Return the number of stars in the catalog.
+// Compute the zone of each node: the minimum V magnitude, B magnitude, and
+// B-V color of its stars, followed by their maxima, as a bound gives position.
+// The zone of an empty node is inverted, so that it overlaps no range.
+
+static void mkzone(float *Z, const node *N, uint32_t c, const star *S)
+{
+    for (uint32_t n = c; n-- > 0; )
+    {
+        float *z = Z + n * 6;
+
+        z[0] = z[1] = z[2] =  HUGE_VALF;
+        z[3] = z[4] = z[5] = -HUGE_VALF;
+
+        if (N[n].nodeL && N[n].nodeR)
+        {
+            const float *l = Z + N[n].nodeL * 6;
+            const float *r = Z + N[n].nodeR * 6;
+
+            for (int i = 0; i < 3; i++)
+            {
+                z[i    ] = min(l[i    ], r[i    ]);
+                z[i + 3] = max(l[i + 3], r[i + 3]);
+            }
+        }
+        else
+        {
+            for (uint32_t s = N[n].star0; s < N[n].star0 + N[n].starc; s++)
+            {
+                const float v = S[s].mag[1];
+                const float b = S[s].mag[0];
+
+                z[0] = min(z[0], v);
+                z[1] = min(z[1], b);
+                z[2] = min(z[2], b - v);
+                z[3] = max(z[3], v);
+                z[4] = max(z[4], b);
+                z[5] = max(z[5], b - v);
+            }
+        }
+    }
+}
+
+// Initialize star s to appear, from the origin, as would the sum of the stars
+// of aggregate a: at their centroid with their total flux and their color
+// weighted by flux. Both are exact as seen from the origin, where luminosity
+// placed at the centroid is not.
+
+void hippo_aggr_star(star *s, const aggr *a)
+{
+    double v = -2.5 * log10(a->flux);
+
+    s->pos[0] = a->pos[0];
+    s->pos[1] = a->pos[1];
+    s->pos[2] = a->pos[2];
+    s->mag[0] = (float) v + a->bv;
+    s->mag[1] = (float) v;
+}
+
+//-----------------------------------------------------------------------------
+
+static inline double rad(double d)
+{
+    return d * 0.017453292519943295;
+}
+
+// Parse the given line as a Hipparcos record and populate the star structure.
+// Also give the position in double precision in p, if requested.
+
+static int parse_hip(star *s, double *p, const char *rec)
+{
+    double r;  // Right ascension
+    double d;  // Declination
+    double q;  // Parallax
+    double b;  // B magnitude
+    double v;  // V magnitude
+    double x[3];
+
+    if (sscanf(rec +  51, "%lf", &r) == 1 &&
+        sscanf(rec +  64, "%lf", &d) == 1 &&
+        sscanf(rec +  79, "%lf", &q) == 1 &&
+        sscanf(rec + 217, "%lf", &b) == 1 &&
+        sscanf(rec + 230, "%lf", &v) == 1 && q > 0.0)
+    {
+        x[0] = sin(rad(r)) * cos(rad(d)) * 3261.63344 / fabs(q);
+        x[1] =               sin(rad(d)) * 3261.63344 / fabs(q);
+        x[2] = cos(rad(r)) * cos(rad(d)) * 3261.63344 / fabs(q);
+
+        s->pos[0] = (float) x[0];
+        s->pos[1] = (float) x[1];
+        s->pos[2] = (float) x[2];
+        s->mag[0] = (float) b;
+        s->mag[1] = (float) v;
+
+        if (p) memcpy(p, x, sizeof (x));
+
+        return 1;
+    }
+    return 0;
+}
+
+// Parse the given line as a Tycho-2 record and populate the star structure.
+// Include only records with both B and V magnitudes, and exclude any record
+// that already appears in the Hipparcos catalog. Also give the position in
+// double precision in p, if requested.
+
+static int parse_tyc(star *s, double *p, const char *rec)
+{
+    int    h;  // Hipparcos number
+    double r;  // Right ascension
+    double d;  // Declination
+    double b;  // B magnitude
+    double v;  // V magnitude
+    double x[3];
+
+    if (sscanf(rec + 142, "%d",  &h) == 0 &&
+        sscanf(rec +  15, "%lf", &r) == 1 &&
+        sscanf(rec +  28, "%lf", &d) == 1 &&
+        sscanf(rec + 110, "%lf", &b) == 1 &&
+        sscanf(rec + 123, "%lf", &v) == 1)
+    {
+        x[0] = sin(rad(r)) * cos(rad(d)) * 32.6163344;
+        x[1] =               sin(rad(d)) * 32.6163344;
+        x[2] = cos(rad(r)) * cos(rad(d)) * 32.6163344;
+
+        s->pos[0] = (float) x[0];
+        s->pos[1] = (float) x[1];
+        s->pos[2] = (float) x[2];
+        s->mag[0] = (float) b;
+        s->mag[1] = (float) v;
+
+        if (p) memcpy(p, x, sizeof (x));
+
+        return 1;
+    }
+    return 0;
+}
+
+// A star accompanied by its position in double precision, as read prior to
+// rebasing.
+
+struct dstar
+{
+    star   s;
+    double p[3];
+};
+
+typedef struct dstar dstar;
+
+typedef int (*parse_fn)(star *s, double *p, const char *rec);
+
+// Count the records of the given stream accepted by the given record parser,
+// and rewind it.
+
+static size_t parse_count(FILE *stream, parse_fn parse)
+{
+    char   buf[MAXRECLEN];
+    size_t n = 0;
+    dstar  s;
+
+    while (fgets(buf, MAXRECLEN, stream))
+        n += parse(&s.s, s.p, buf);
+
+    rewind(stream);
+    return n;
+}
+
+// Read at most n records of the given stream using the given record parser
+// into array S, z bytes apart, each a star or a dstar. Return their number.
+
+static uint32_t parse_read(FILE *stream, parse_fn parse, void *S, size_t z,
+                           uint32_t n)
+{
+    char     buf[MAXRECLEN];
+    uint32_t c;
+
+    for (c = 0; c < n && fgets(buf, MAXRECLEN, stream); )
+    {
+        char *t = (char *) S + c * z;
+        c += parse((star *) t, (z == sizeof (dstar)) ? ((dstar *) t)->p : NULL, buf);
+    }
+    return c;
+}
+
+// Store the stars of catalog H relative to the centers of their leaf nodes,
+// given their double-precision positions D in index order, and store the node
+// centers. Leaf centers are the centers of the extents of their stars.
+// Interior node centers are the centers of their bounds. The centers need not
+// be aligned within the image, so each is copied into place.
+
+static void rebase(hippo *H, const dstar *D)
+{
+    star *S = H->stars;
+
+    for (uint32_t n = 0; n < H->nodec; n++)
+    {
+        const node *N = H->nodes + n;
+        double      o[3];
+
+        if (N->nodeL && N->nodeR)
+        {
+            o[0] = ((double) N->bound[0] + (double) N->bound[3]) * 0.5;
+            o[1] = ((double) N->bound[1] + (double) N->bound[4]) * 0.5;
+            o[2] = ((double) N->bound[2] + (double) N->bound[5]) * 0.5;
+        }
+        else if (N->starc)
+        {
+            double b[6];
+
+            memcpy(b + 0, D[N->star0].p, sizeof (D->p));
+            memcpy(b + 3, D[N->star0].p, sizeof (D->p));
+
+            for (uint32_t s = N->star0; s < N->star0 + N->starc; s++)
+                for (int i = 0; i < 3; i++)
+                {
+                    b[i    ] = (b[i    ] < D[s].p[i]) ? b[i    ] : D[s].p[i];
+                    b[i + 3] = (b[i + 3] > D[s].p[i]) ? b[i + 3] : D[s].p[i];
+                }
+
+            o[0] = (b[0] + b[3]) * 0.5;
+            o[1] = (b[1] + b[4]) * 0.5;
+            o[2] = (b[2] + b[5]) * 0.5;
+
+            for (uint32_t s = N->star0; s < N->star0 + N->starc; s++)
+            {
+                S[s].pos[0] = (float) (D[s].p[0] - o[0]);
+                S[s].pos[1] = (float) (D[s].p[1] - o[1]);
+                S[s].pos[2] = (float) (D[s].p[2] - o[2]);
+                S[s].mag[0] = D[s].s.mag[0];
+                S[s].mag[1] = D[s].s.mag[1];
+            }
+        }
+        else o[0] = o[1] = o[2] = 0.0;
+
+        memcpy((char *) H->cents + n * sizeof (o), o, sizeof (o));
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Generate an index of depth d for c stars. If f includes HIPPO_MORTON_TREE,
+// lay out the whole catalog in Morton order and split each node at its middle
+// star. Otherwise, split along alternating axes and, if f includes
+// HIPPO_MORTON_LEAF, order the stars of each leaf by Morton code. Either way,
+// if f includes HIPPO_BRIGHT_LEAF, order the stars of each leaf by magnitude
+// instead. Return the number of nodes, or 0 on failure.
+
+static uint32_t mkindex(node *N, uint32_t d, void *S, size_t z, uint32_t c, int f)
+{
+    uint32_t n;
+    float    b[6];
+
+    if (f & HIPPO_MORTON_TREE)
+    {
+        star_bound(b, S, z, 0, c);
+
+        if (morton_sort(S, z, 0, c, b) == 0)
+            return 0;
+
+        n = mknode(N, 0, 1, d, S, z, 0, c, 3);
+        f = f & ~HIPPO_MORTON_LEAF;
+    }
+    else
+        n = mknode(N, 0, 1, d, S, z, 0, c, 0);
+
+    if ((f & (HIPPO_MORTON_LEAF | HIPPO_BRIGHT_LEAF)) && sort_leaves(N, n, S, z, f) == 0)
+        return 0;
+
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+
+// Advise the kernel regarding the pages spanned by stars s0 through s1. Tiles
+// are not page-aligned, as stars are packed contiguously, so a page may hold
+// the stars of two tiles. When fetching, round outward so that the whole tile
+// arrives, along with a little of its neighbors. When releasing, round inward
+// so as not to discard pages shared with a neighbor, leaving at most two
+// pages of an evicted tile resident.
+
+static void page_advise(const hippo *H, uint32_t s0, uint32_t s1, int advice)
+{
+    const uintptr_t z = (uintptr_t) sysconf(_SC_PAGESIZE);
+
+    uintptr_t a = (uintptr_t) (H->stars + s0);
+    uintptr_t b = (uintptr_t) (H->stars + s1);
+
+    if (advice == MADV_DONTNEED)
+    {
+        a = (a + z - 1) & ~(z - 1);
+        b = (b        ) & ~(z - 1);
+    }
+    else
+    {
+        a = (a        ) & ~(z - 1);
+        b = (b + z - 1) & ~(z - 1);
+    }
+    if (a < b)
+        madvise((void *) a, (size_t) (b - a), advice);
+}
+
+// Note a use of the tile rooted at node n. Flag a resident tile as used,
+// writing the flag only if it is clear. Otherwise load the tile into the ring,
+// first sweeping the hand to evict an unused tile if the ring is full. Each
+// sweep clears the flags it passes, so an eviction takes constant amortized
+// time.
+
+static void page_touch(const hippo *H, uint32_t n)
+{
+    page *P = H->pages;
+
+    if (__atomic_load_n(P->live + n, __ATOMIC_ACQUIRE))
+    {
+        if (__atomic_load_n(P->used + n, __ATOMIC_RELAXED) == 0)
+            __atomic_store_n(P->used + n, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    pthread_mutex_lock(&P->mutex);
+
+    if (P->live[n] == 0)
+    {
+        if (P->c == P->n)
+        {
+            uint32_t e;
+
+            while (__atomic_exchange_n(P->used + P->ring[P->hand], 0,
+                                       __ATOMIC_RELAXED))
+                P->hand = (P->hand + 1) % P->n;
+
+            e = P->ring[P->hand];
+
+            __atomic_store_n(P->live + e, 0, __ATOMIC_RELEASE);
+
+            page_advise(H, H->nodes[e].star0,
+                           H->nodes[e].star0 + H->nodes[e].starc, MADV_DONTNEED);
+            P->c--;
+        }
+        else P->hand = P->c;
+
+        page_advise(H, H->nodes[n].star0,
+                       H->nodes[n].star0 + H->nodes[n].starc, MADV_WILLNEED);
+
+        P->ring[P->hand] = n;
+        P->hand = (P->hand + 1) % P->n;
+
+        __atomic_store_n(P->used + n, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(P->live + n, 1, __ATOMIC_RELEASE);
+        P->c++;
+    }
+    pthread_mutex_unlock(&P->mutex);
+}
+
+// Note a use of the tile containing node n, or of all tiles beneath it, for
+// traversals that do not track depth.
+
+static void page_node(const hippo *H, uint32_t n)
+{
+    if (H->pages->tile[n] != NONE)
+        page_touch(H, H->pages->tile[n]);
+    else
+    {
+        page_node(H, H->nodes[n].nodeL);
+        page_node(H, H->nodes[n].nodeR);
+    }
+}
+
+// Note the tile root t of node n at depth d, or NONE if n has tiles beneath.
+
+static void page_tile(const hippo *H, uint32_t n, uint32_t d, uint32_t t)
+{
+    const int l = (H->nodes[n].nodeL == 0 || H->nodes[n].nodeR == 0);
+
+    if (d == H->pages->k || (d < H->pages->k && l))
+        t = n;
+
+    H->pages->tile[n] = t;
+
+    if (!l)
+    {
+        page_tile(H, H->nodes[n].nodeL, d + 1, t);
+        page_tile(H, H->nodes[n].nodeR, d + 1, t);
+    }
+}
+
+// Note a use of all tiles beneath node n at depth d.
+
+static void page_range(const hippo *H, uint32_t n, uint32_t d)
+{
+    if (d < H->pages->k && H->nodes[n].nodeL && H->nodes[n].nodeR)
+    {
+        page_range(H, H->nodes[n].nodeL, d + 1);
+        page_range(H, H->nodes[n].nodeR, d + 1);
+    }
+    else page_touch(H, n);
+}
+
+// Enable demand paging of a mapped catalog, treating each subtree rooted at
+// depth k as a tile and retaining at most n tiles. Tiles are fetched when a
+// query first reaches them and released when they fall out of use.
+
+int hippo_page(hippo *H, uint32_t k, uint32_t n)
+{
+    page *P;
+
+    if (H && (H->own & OWN_MAP) && H->pages == NULL && n > 0 && H->nodec > 0)
+    {
+        if (n > H->nodec)
+            n = H->nodec;
+
+        if ((P = (page *) calloc(sizeof (page), 1)))
+        {
+            P->ring = (uint32_t *) calloc(n,        sizeof (uint32_t));
+            P->tile = (uint32_t *) calloc(H->nodec, sizeof (uint32_t));
+            P->used = (uint8_t  *) calloc(H->nodec, sizeof (uint8_t));
+            P->live = (uint8_t  *) calloc(H->nodec, sizeof (uint8_t));
+
+            if (P->ring && P->tile && P->used && P->live)
+            {
+                pthread_mutex_init(&P->mutex, NULL);
+
+                P->k = k;
+                P->n = n;
+
+                H->pages = P;
+
+                page_tile(H, 0, 0, NONE);
+
+                // Drop any stars already resident and disable read-ahead.
+
+                page_advise(H, 0, H->starc, MADV_DONTNEED);
+                page_advise(H, 0, H->starc, MADV_RANDOM);
+                return 1;
+            }
+            free(P->live);
+            free(P->used);
+            free(P->tile);
+            free(P->ring);
+            free(P);
+        }
+    }
+    return 0;
+}
+
+// Release the paging state of a catalog.
+
+static void page_free(hippo *H)
+{
+    if (H->pages)
+    {
+        pthread_mutex_destroy(&H->pages->mutex);
+        free(H->pages->live);
+        free(H->pages->used);
+        free(H->pages->tile);
+        free(H->pages->ring);
+        free(H->pages);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// CRC-32C (Castagnoli) in its reflected form. The portable implementation
+// uses eight tables, consuming eight bytes per step, and x86 processors with
+// SSE 4.2 use the CRC32 instruction instead.
+
+#define CRC_POLY 0x82F63B78
+
+static uint32_t       crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+
+        for (int j = 0; j < 8; j++)
+            c = (c & 1) ? (c >> 1) ^ CRC_POLY : (c >> 1);
+
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int j = 1; j < 8; j++)
+            crc_table[j][i] = (crc_table[j - 1][i] >> 8)
+                            ^  crc_table[0][crc_table[j - 1][i] & 0xFF];
+}
+
+static uint32_t crc_soft(uint32_t c, const uint8_t *p, size_t n)
+{
+    uint32_t a, b;
+
+    for (; n && ((uintptr_t) p & 3); n--)
+        c = crc_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        memcpy(&a, p,     4);
+        memcpy(&b, p + 4, 4);
+
+        a ^= c;
+        c = crc_table[7][ a        & 0xFF] ^ crc_table[6][(a >>  8) & 0xFF]
+          ^ crc_table[5][(a >> 16) & 0xFF] ^ crc_table[4][ a >> 24        ]
+          ^ crc_table[3][ b        & 0xFF] ^ crc_table[2][(b >>  8) & 0xFF]
+          ^ crc_table[1][(b >> 16) & 0xFF] ^ crc_table[0][ b >> 24        ];
+    }
+
+    for (; n; n--)
+        c = crc_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+
+    return c;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2")))
+static uint32_t crc_hard(uint32_t c, const uint8_t *p, size_t n)
+{
+    uint64_t d = c;
+    uint64_t w;
+
+    for (; n && ((uintptr_t) p & 7); n--)
+        d = _mm_crc32_u8((uint32_t) d, *p++);
+
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        memcpy(&w, p, 8);
+        d = _mm_crc32_u64(d, w);
+    }
+
+    for (; n; n--)
+        d = _mm_crc32_u8((uint32_t) d, *p++);
+
+    return (uint32_t) d;
+}
+#endif
+
+// Return the CRC-32C of n bytes at p.
+
+static uint32_t crc(const void *p, size_t n)
+{
+    pthread_once(&crc_once, crc_init);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("sse4.2"))
+        return ~crc_hard(0xFFFFFFFF, (const uint8_t *) p, n);
+#endif
+    return ~crc_soft(0xFFFFFFFF, (const uint8_t *) p, n);
+}
+
+// Multiply the vector v by the 32x32 GF(2) matrix M.
+
+static uint32_t gf2_times(const uint32_t *M, uint32_t v)
+{
+    uint32_t s = 0;
+
+    for (; v; v >>= 1, M++)
+        if (v & 1)
+            s ^= *M;
+
+    return s;
+}
+
+static void gf2_square(uint32_t *S, const uint32_t *M)
+{
+    for (int i = 0; i < 32; i++)
+        S[i] = gf2_times(M, M[i]);
+}
+
+// Given the CRCs a and b of two consecutive blocks, the second of length n,
+// return the CRC of their concatenation.
+
+static uint32_t crc_combine(uint32_t a, uint32_t b, size_t n)
+{
+    uint32_t E[32];
+    uint32_t O[32];
+
+    if (n == 0)
+        return a;
+
+    // Build the operator that appends one zero bit, then square it to append
+    // two and four zero bits.
+
+    O[0] = CRC_POLY;
+
+    for (int i = 1; i < 32; i++)
+        O[i] = 1u << (i - 1);
+
+    gf2_square(E, O);
+    gf2_square(O, E);
+
+    // Append n zero bytes to a, squaring the operator for each bit of n.
+
+    do
+    {
+        gf2_square(E, O);
+        if (n & 1) a = gf2_times(E, a);
+        if ((n >>= 1) == 0) break;
+
+        gf2_square(O, E);
+        if (n & 1) a = gf2_times(O, a);
+        n >>= 1;
+    }
+    while (n);
+
+    return a ^ b;
+}
+
+// A CRC job covers one block of a parallel CRC computation.
+
+struct crc_job
+{
+    const uint8_t *p;
+    size_t         n;
+    uint32_t       c;
+};
+
+static void *crc_work(void *data)
+{
+    struct crc_job *j = (struct crc_job *) data;
+
+    j->c = crc(j->p, j->n);
+    return NULL;
+}
+
+// Return the CRC-32C of n bytes at p, computed in up to one block per
+// processor and combined.
+
+#define CRC_BLOCK (4 << 20)
+#define CRC_JOBS  64
+
+static uint32_t crc_par(const void *p, size_t n)
+{
+    struct crc_job J[CRC_JOBS];
+    pthread_t      T[CRC_JOBS];
+    int            s[CRC_JOBS];
+    long           t = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t         b;
+    uint32_t       c;
+    int            k;
+
+    t = (t < 1) ? 1 : (t > CRC_JOBS) ? CRC_JOBS : t;
+    b = (n + t - 1) / t;
+    b = (b < CRC_BLOCK) ? CRC_BLOCK : b;
+
+    if (n <= b)
+        return crc(p, n);
+
+    // Start a thread for each block after the first, and do the first here.
+
+    for (k = 0; (size_t) k * b < n; k++)
+    {
+        J[k].p = (const uint8_t *) p + k * b;
+        J[k].n = (n - k * b < b) ? n - k * b : b;
+
+        if (k)
+            s[k] = pthread_create(T + k, NULL, crc_work, J + k);
+    }
+    crc_work(J);
+
+    for (int i = 1; i < k; i++)
+        if (s[i] == 0)
+            pthread_join(T[i], NULL);
+        else
+            crc_work(J + i);
+
+    for (c = J[0].c, b = 1; b < (size_t) k; b++)
+        c = crc_combine(c, J[b].c, J[b].n);
+
+    return c;
+}
+
+//-----------------------------------------------------------------------------
+
+// Return a four-character code of the given string.
+
+static uint32_t fourcc(const char *s)
+{
+    return s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24;
+}
+
+// Search a RIFF and return a pointer to the chunk with the given FOURCC.
+
+static void *riff_chunk(void *p, uint32_t cc)
+{
+    uint32_t *b = (uint32_t *) p;
+
+    if (b[0] == fourcc("RIFF"))
+
+        for (uint32_t *c = b + 2; c < b + 2 + b[1] / 4;
+                                  c = c + 2 + c[1] / 4)
+            if (c[0] == cc)
+                return c;
+
+    return 0;
+}
+
+// Locate the chunks of the RIFF image of catalog H.
+
+static void riff_find(hippo *H)
+{
+    uint32_t *c;
+
+    if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("STAR"))) ||
+        (c = (uint32_t *) riff_chunk(H->ptr, fourcc("STRB"))))
+    {
+        H->stars =   (star *) (c + 2);
+        H->starc = (uint32_t) (c[1] / sizeof (star));
+    }
+
+    if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("NODE"))))
+    {
+        H->nodes =   (node *) (c + 2);
+        H->nodec = (uint32_t) (c[1] / sizeof (node));
+    }
+
+    if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("AGGR"))))
+    {
+        if (c[1] == H->nodec * sizeof (aggr))
+            H->aggrs = (aggr *) (c + 2);
+    }
+
+    if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("ZONE"))))
+    {
+        if (c[1] == H->nodec * 6 * sizeof (float))
+            H->zones = (float *) (c + 2);
+    }
+
+    if ((c = (uint32_t *) riff_chunk(H->ptr, fourcc("CENT"))))
+    {
+        if (c[1] == H->nodec * 3 * sizeof (double))
+            H->cents = (void *) (c + 2);
+    }
+
+    // Rebased stars are useless without their centers.
+
+    if (H->cents == NULL && riff_chunk(H->ptr, fourcc("STRB")))
+    {
+        H->stars = NULL;
+        H->starc = 0;
+    }
+}
+
+// Map the RIFF open at file descriptor H->fd and locate its chunks. Return 0
+// if the file cannot be mapped.
+
+static int riff_map(hippo *H, int prot, int flags)
+{
+    struct stat st;
+
+    if ((fstat(H->fd, &st)) != -1 && st.st_size > 8)
+    {
+        if ((H->ptr = mmap(0, st.st_size, prot, flags, H->fd, 0)) != MAP_FAILED)
+        {
+            H->len  = (size_t) st.st_size;
+            H->own |= OWN_MAP;
+
+            // Acquire the header, which a publisher releases last.
+
+            if (__atomic_load_n((uint32_t *) H->ptr, __ATOMIC_ACQUIRE) == fourcc("RIFF"))
+                riff_find(H);
+            return 1;
+        }
+        H->ptr = 0;
+    }
+    return 0;
+}
+
+// Read a catalog from the named file in RIFF format.
+
+hippo *hippo_read(const char *filename)
+{
+    hippo *H;
+
+    if ((H = (hippo *) calloc(sizeof (hippo), 1)))
+    {
+        if ((H->fd = open(filename, O_RDONLY)) != -1)
+        {
+            H->own |= OWN_FILE;
+
+            if (riff_map(H, PROT_READ, MAP_PRIVATE))
+                return H;
+        }
+    }
+    hippo_free(H);
+    return NULL;
+}
+
+// Verify the chunk of mapped catalog H with the FOURCC given by string cc, or
+// all chunks if cc is NULL, against the checksums recorded when it was written.
+// Return 1 if all match, 0 if any does not, or -1 if none were recorded.
+
+int hippo_verify(const hippo *H, const char *cc)
+{
+    uint32_t *e = (uint32_t *) ((char *) H->ptr + H->len);
+    uint32_t *b = (uint32_t *) H->ptr;
+    uint32_t *k;
+    uint32_t *c;
+    int       stat = -1;
+
+    if (b && (size_t) b[1] + 8 <= H->len && (k = (uint32_t *) riff_chunk(b, fourcc("CRCS"))))
+    {
+        for (uint32_t i = 0; i < k[1] / 8; i++)
+            if (cc == NULL || k[2 + i * 2] == fourcc(cc))
+            {
+                if ((c = (uint32_t *) riff_chunk(b, k[2 + i * 2])) &&
+                    (c + 2 + c[1] / 4 <= e) &&
+                    (crc_par(c + 2, c[1]) == k[3 + i * 2]))
+                {
+                    if (stat) stat = 1;
+                }
+                else stat = 0;
+            }
+    }
+    return stat;
+}
+
+// Release all resources held by this catalog. A view does not own the stars
+// of its parent.
+
+void hippo_free(hippo *H)
+{
+    if (H)
+    {
+        page_free(H);
+
+        if (H->own & OWN_AGGR)  free(H->aggrs);
+        if (H->own & OWN_MAP)   munmap(H->ptr, H->len);
+        if (H->own & OWN_IMAGE) free(H->ptr);
+        if (H->own & OWN_FILE)  close(H->fd);
+
+        free(H);
+    }
+}
+
+// A chunk table entry gives the FOURCC, length, and contents of one chunk of
+// a catalog to be written.
+
+#define CHUNKS 8
+
+struct chunk
+{
+    uint32_t    cc;
+    uint32_t    len;
+    const void *ptr;
+};
+
+typedef struct chunk chunk;
+
+// Fill the chunk table C with the chunks of catalog H, in file order, and
+// return their number. The last is a CRCS chunk giving the FOURCC and CRC of
+// each of the others. Compute these into k, if given.
+
+static int riff_table(const hippo *H, chunk *C, uint32_t *k)
+{
+    int n = 0;
+
+    C[n].cc  = fourcc(H->cents ? "STRB" : "STAR");
+    C[n].len = (uint32_t) (H->starc * sizeof (star));
+    C[n].ptr = H->stars;
+    n++;
+
+    C[n].cc  = fourcc("NODE");
+    C[n].len = (uint32_t) (H->nodec * sizeof (node));
+    C[n].ptr = H->nodes;
+    n++;
+
+    if (H->aggrs)
+    {
+        C[n].cc  = fourcc("AGGR");
+        C[n].len = (uint32_t) (H->nodec * sizeof (aggr));
+        C[n].ptr = H->aggrs;
+        n++;
+    }
+
+    if (H->zones)
+    {
+        C[n].cc  = fourcc("ZONE");
+        C[n].len = (uint32_t) (H->nodec * 6 * sizeof (float));
+        C[n].ptr = H->zones;
+        n++;
+    }
+
+    if (H->cents)
+    {
+        C[n].cc  = fourcc("CENT");
+        C[n].len = (uint32_t) (H->nodec * 3 * sizeof (double));
+        C[n].ptr = H->cents;
+        n++;
+    }
+
+    for (int i = 0; k && i < n; i++)
+    {
+        k[i * 2 + 0] = C[i].cc;
+        k[i * 2 + 1] = crc_par(C[i].ptr, C[i].len);
+    }
+
+    C[n].cc  = fourcc("CRCS");
+    C[n].len = (uint32_t) (n * 8);
+    C[n].ptr = k;
+    n++;
+
+    return n;
+}
+
+// Return the size of the RIFF body of the n chunks of table C.
+
+static uint32_t riff_size(const chunk *C, int n)
+{
+    uint32_t s = 0;
+
+    for (int i = 0; i < n; i++)
+        s += 8 + C[i].len;
+
+    return s;
+}
+
+// Return 1 if the RIFF image of catalog H consists of exactly the n chunks of
+// table C, in order, so that it may be copied as it stands.
+
+static int riff_whole(const hippo *H, const chunk *C, int n)
+{
+    const uint32_t *b = (const uint32_t *) H->ptr;
+    const uint32_t *c;
+
+    if (b == NULL || b[0] != fourcc("RIFF") || b[1] != riff_size(C, n)
+                  || (size_t) b[1] + 8 != H->len)
+        return 0;
+
+    c = b + 2;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (c[0] != C[i].cc || c[1] != C[i].len || (C[i].ptr && C[i].ptr != c + 2))
+            return 0;
+
+        c = c + 2 + c[1] / 4;
+    }
+    return 1;
+}
+
+// Write all n buffers of v to file descriptor fd, resuming after any short
+// write. Return 0 on failure.
+
+static int riff_writev(int fd, struct iovec *v, int n)
+{
+    ssize_t k;
+
+    while (n > 0)
+    {
+        if ((k = writev(fd, v, n)) < 0)
+            return 0;
+
+        while (n > 0 && (size_t) k >= v->iov_len)
+        {
+            k -= (ssize_t) v->iov_len;
+            v++;
+            n--;
+        }
+        if (n > 0)
+        {
+            v->iov_base = (char *) v->iov_base + k;
+            v->iov_len -= (size_t) k;
+        }
+    }
+    return 1;
+}
+
+// Return the mode to give a file replacing the named one: that of the file if
+// it exists, or else the mode a newly created file would receive.
+
+static mode_t file_mode(const char *filename)
+{
+    struct stat st;
+    mode_t      u;
+
+    if (stat(filename, &st) == 0)
+        return st.st_mode & 07777;
+
+    u = umask(0);
+    umask(u);
+
+    return 0666 & ~u;
+}
+
+// Flush the directory containing the named file, making durable any entry
+// just renamed into it. Return 0 on failure.
+
+static int sync_dir(const char *filename)
+{
+    const char *s = strrchr(filename, '/');
+    char       *d;
+    int         fd;
+    int         stat = 0;
+
+    if ((d = (char *) malloc(s ? (size_t) (s - filename) + 2 : 2)))
+    {
+        if (s == NULL)
+            strcpy(d, ".");
+        else if (s == filename)
+            strcpy(d, "/");
+        else
+        {
+            memcpy(d, filename, (size_t) (s - filename));
+            d[s - filename] = 0;
+        }
+
+        if ((fd = open(d, O_RDONLY | O_DIRECTORY)) != -1)
+        {
+            stat = (fsync(fd) == 0);
+            close(fd);
+        }
+        free(d);
+    }
+    return stat;
+}
+
+// Write the catalog contents to the named file in RIFF format. Write an image
+// holding exactly the chunks of the catalog as it stands, or else gather all
+// chunks into a single vectored write, to a temporary file in the same
+// directory, flush it to disk, and rename it over the named file. Readers
+// holding the old file mapped are unaffected, and a crash leaves either the
+// old file or the new one, never a mix. The new file takes the mode of the
+// old, if any, and the rename is flushed along with its directory.
+
+int hippo_write(hippo *H, const char *filename)
+{
+    int   fd   = 0;
+    int   stat = 0;
+    char *temp;
+
+    assert(sizeof (float) == 4);
+
+    if (H && H->parent == NULL && (temp = (char *) malloc(strlen(filename) + 8)))
+    {
+        sprintf(temp, "%s.XXXXXX", filename);
+
+        if ((fd = mkstemp(temp)) != -1)
+        {
+            struct iovec v[CHUNKS * 2 + 1];
+            chunk        C[CHUNKS];
+            uint32_t     h[CHUNKS * 2 + 2];
+            uint32_t     x[CHUNKS * 2];
+
+            int n = riff_table(H, C, NULL);
+            int k = 0;
+
+            if (riff_whole(H, C, n))
+            {
+                v[k].iov_base = H->ptr;
+                v[k].iov_len  = H->len;
+                k++;
+            }
+            else
+            {
+                n = riff_table(H, C, x);
+
+                h[0] = fourcc("RIFF");
+                h[1] = riff_size(C, n);
+
+                v[k].iov_base = h;
+                v[k].iov_len  = 8;
+                k++;
+
+                for (int i = 0; i < n; i++)
+                {
+                    h[2 + i * 2] = C[i].cc;
+                    h[3 + i * 2] = C[i].len;
+
+                    v[k].iov_base = h + 2 + i * 2;
+                    v[k].iov_len  = 8;
+                    k++;
+                    v[k].iov_base = (void *) C[i].ptr;
+                    v[k].iov_len  = C[i].len;
+                    k++;
+                }
+            }
+
+            stat = (fchmod(fd, file_mode(filename)) == 0
+                 && riff_writev(fd, v, k)
+                 && fsync(fd) == 0);
+
+            if (close(fd) || !stat || rename(temp, filename))
+            {
+                unlink(temp);
+                stat = 0;
+            }
+            else stat = sync_dir(filename);
+        }
+        free(temp);
+    }
+    return stat;
+}
+
+//-----------------------------------------------------------------------------
+
+// Copy the catalog contents in RIFF format to the mapped region p, in one
+// piece if its image holds exactly its chunks. Release the RIFF header last so
+// that a process attaching concurrently never sees a valid header on
+// incomplete contents.
+
+static void riff_copy(const hippo *H, uint32_t *p)
+{
+    chunk     C[CHUNKS];
+    uint32_t  k[CHUNKS * 2];
+    int       n = riff_table(H, C, NULL);
+    uint32_t *c = p + 2;
+
+    if (riff_whole(H, C, n))
+        memcpy(c, (const uint32_t *) H->ptr + 2, H->len - 8);
+    else
+    {
+        riff_table(H, C, k);
+
+        for (int i = 0; i < n; i++)
+        {
+            c[0] = C[i].cc;
+            c[1] = C[i].len;
+            memcpy(c + 2, C[i].ptr, C[i].len);
+            c = c + 2 + C[i].len / 4;
+        }
+    }
+
+    p[1] = riff_size(C, n);
+
+    __atomic_store_n(p, fourcc("RIFF"), __ATOMIC_RELEASE);
+}
+
+// A catalog is published as a shared memory object named by appending its
+// version number to the published name. The published name itself holds an
+// index giving the FOURCC "HIPV" and the current version. A new version is
+// switched in only once complete, and the old version is unlinked after, so
+// the published name always leads to a complete catalog.
+
+#define SHM_NAME 256
+
+static void shm_version(char *s, const char *name, uint32_t v)
+{
+    snprintf(s, SHM_NAME, "%s.%u", name, v);
+}
+
+// Map the version index published under the given name, creating it if c is
+// nonzero. Return NULL if it does not exist or is not an index.
+
+static uint32_t *shm_index(const char *name, int c)
+{
+    struct stat st;
+    void       *p = MAP_FAILED;
+    int         fd;
+
+    if ((fd = shm_open(name, c ? (O_RDWR | O_CREAT) : O_RDONLY, 0644)) != -1)
+    {
+        if (fstat(fd, &st) == 0 && (st.st_size == 8 ||
+                      (c && st.st_size == 0 && ftruncate(fd, 8) == 0)))
+            p = mmap(0, 8, c ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                     MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    return (p == MAP_FAILED) ? NULL : (uint32_t *) p;
+}
+
+// Publish the catalog under the given name as a new version. Any catalog
+// previously published under that name is unlinked once the new version is
+// in place, but remains valid for all processes that have already attached
+// to it.
+
+int hippo_publish(hippo *H, const char *name)
+{
+    char      s[SHM_NAME];
+    uint32_t *x;
+    uint32_t  v;
+    uint32_t  u;
+    int       fd   = 0;
+    int       stat = 0;
+    void     *ptr;
+
+    if (H && H->parent == NULL && strlen(name) + 12 < SHM_NAME)
+    {
+        chunk  C[CHUNKS];
+        size_t len = 8 + (size_t) riff_size(C, riff_table(H, C, NULL));
+
+        // Replace any object under this name that is not an index.
+
+        if ((x = shm_index(name, 1)) == NULL)
+        {
+            shm_unlink(name);
+            x = shm_index(name, 1);
+        }
+
+        if (x)
+        {
+            v = __atomic_load_n(x + 1, __ATOMIC_ACQUIRE);
+            u = (v + 1) ? (v + 1) : 1;
+
+            shm_version(s, name, u);
+            shm_unlink (s);
+
+            if ((fd = shm_open(s, O_RDWR | O_CREAT | O_EXCL, 0644)) != -1)
+            {
+                if (ftruncate(fd, (off_t) len) == 0)
+                {
+                    ptr = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+                    if (ptr != MAP_FAILED)
+                    {
+                        riff_copy(H, (uint32_t *) ptr);
+                        munmap(ptr, len);
+                        stat = 1;
+                    }
+                }
+                close(fd);
+            }
+
+            if (stat)
+            {
+                x[0] = fourcc("HIPV");
+                __atomic_store_n(x + 1, u, __ATOMIC_RELEASE);
+
+                if (v)
+                {
+                    shm_version(s, name, v);
+                    shm_unlink (s);
+                }
+            }
+            else shm_unlink(s);
+
+            munmap(x, 8);
+        }
+    }
+    return stat;
+}
+
+// Withdraw the shared memory catalog with the given name. Attached processes
+// are unaffected.
+
+int hippo_unpublish(const char *name)
+{
+    char      s[SHM_NAME];
+    uint32_t *x;
+    uint32_t  v;
+
+    if (strlen(name) + 12 < SHM_NAME && (x = shm_index(name, 0)))
+    {
+        if ((v = __atomic_load_n(x + 1, __ATOMIC_ACQUIRE)))
+        {
+            shm_version(s, name, v);
+            shm_unlink (s);
+        }
+        munmap(x, 8);
+    }
+    return (shm_unlink(name) == 0);
+}
+
+// Attach to the shared memory object with the given name holding a catalog.
+
+static hippo *shm_attach(const char *s)
+{
+    hippo *H;
+
+    if ((H = (hippo *) calloc(sizeof (hippo), 1)))
+    {
+        if ((H->fd = shm_open(s, O_RDONLY, 0)) != -1)
+        {
+            H->own |= OWN_FILE;
+
+            if (riff_map(H, PROT_READ, MAP_SHARED) && H->stars && H->nodes)
+                return H;
+        }
+    }
+    hippo_free(H);
+    return NULL;
+}
+
+// Attach to the current version of the catalog published under the given
+// name. If that version is unlinked by a newer publication before it can be
+// opened, attach to the newer one instead. Return NULL if no catalog has been
+// published under that name.
+
+hippo *hippo_attach(const char *name)
+{
+    char      s[SHM_NAME];
+    hippo    *H = NULL;
+    uint32_t *x;
+    uint32_t  v;
+
+    if (strlen(name) + 12 < SHM_NAME && (x = shm_index(name, 0)))
+    {
+        do
+            if ((v = __atomic_load_n(x + 1, __ATOMIC_ACQUIRE)) && x[0] == fourcc("HIPV"))
+            {
+                shm_version(s, name, v);
+                H = shm_attach(s);
+            }
+        while (H == NULL && v && v != __atomic_load_n(x + 1, __ATOMIC_ACQUIRE));
+
+        munmap(x, 8);
+    }
+    return H;
+}
+
+//-----------------------------------------------------------------------------
+
+// Image chunk flags: a catalog image with a STAR chunk, an AGGR chunk, a CENT
+// chunk, and a CRCS chunk. NODE and ZONE chunks are always present. The stars
+// of an image with centers are rebased, and their chunk is STRB instead.
+
+#define IMAGE_STAR 1
+#define IMAGE_AGGR 2
+#define IMAGE_CENT 4
+#define IMAGE_CRCS 8
+
+#define IMAGE_ALIGN 64
+
+// Allocate for catalog H a single aligned region laid out exactly as a RIFF
+// file with s stars, n nodes, and the chunks given by flags f, write its chunk
+// headers, and locate its chunks. Chunk contents are left uninitialized.
+// Return 0 on failure.
+
+static int riff_alloc(hippo *H, size_t s, size_t n, int f)
+{
+    chunk     C[CHUNKS];
+    void     *p;
+    uint32_t *c;
+    int       k = 0;
+
+    // Chunk and RIFF lengths are 32-bit. Refuse an image whose body would
+    // exceed them rather than truncate its lengths.
+
+    if (s * sizeof (star) + n * (sizeof (node) + sizeof (aggr)
+                               + 6 * sizeof (float) + 3 * sizeof (double))
+                          + 16 * CHUNKS > UINT32_MAX)
+        return 0;
+
+    memset(C, 0, sizeof (C));
+
+    if (f & IMAGE_STAR)
+    {
+        C[k].cc  = fourcc((f & IMAGE_CENT) ? "STRB" : "STAR");
+        C[k].len = (uint32_t) (s * sizeof (star));
+        k++;
+    }
+
+    C[k].cc  = fourcc("NODE");
+    C[k].len = (uint32_t) (n * sizeof (node));
+    k++;
+
+    if (f & IMAGE_AGGR)
+    {
+        C[k].cc  = fourcc("AGGR");
+        C[k].len = (uint32_t) (n * sizeof (aggr));
+        k++;
+    }
+
+    C[k].cc  = fourcc("ZONE");
+    C[k].len = (uint32_t) (n * 6 * sizeof (float));
+    k++;
+
+    if (f & IMAGE_CENT)
+    {
+        C[k].cc  = fourcc("CENT");
+        C[k].len = (uint32_t) (n * 3 * sizeof (double));
+        k++;
+    }
+
+    if (f & IMAGE_CRCS)
+    {
+        C[k].cc  = fourcc("CRCS");
+        C[k].len = (uint32_t) (k * 8);
+        k++;
+    }
+
+    if (posix_memalign(&p, IMAGE_ALIGN, 8 + (size_t) riff_size(C, k)) == 0)
+    {
+        H->ptr  = p;
+        H->len  = 8 + (size_t) riff_size(C, k);
+        H->own |= OWN_IMAGE;
+
+        c = (uint32_t *) p;
+        c[0] = fourcc("RIFF");
+        c[1] = riff_size(C, k);
+        c = c + 2;
+
+        for (int i = 0; i < k; i++)
+        {
+            c[0] = C[i].cc;
+            c[1] = C[i].len;
+            c = c + 2 + C[i].len / 4;
+        }
+
+        riff_find(H);
+        return 1;
+    }
+    return 0;
+}
+
+// Record the FOURCC and CRC of each chunk of the image of catalog H in its
+// CRCS chunk, which follows them.
+
+static void riff_seal(hippo *H)
+{
+    uint32_t *b = (uint32_t *) H->ptr;
+    uint32_t *k = (uint32_t *) riff_chunk(b, fourcc("CRCS"));
+    uint32_t  i = 0;
+
+    if (k)
+        for (uint32_t *c = b + 2; c < k; c = c + 2 + c[1] / 4, i++)
+        {
+            k[2 + i * 2] = c[0];
+            k[3 + i * 2] = crc_par(c + 2, c[1]);
+        }
+}
+
+// Read a catalog in Hipparcos format, or Tycho-2 format if f includes
+// HIPPO_TYC, and generate its index. If f includes HIPPO_REBASE, store each
+// star relative to the double-precision center of its leaf. Ordering flags
+// are as given to mkindex. The index has a known number of nodes, so the
+// whole catalog is built in place within a single image, as written.
+
+hippo *hippo_read_dat(const char *filename, uint32_t d, int f)
+{
+    const parse_fn p = (f & HIPPO_TYC) ? parse_tyc : parse_hip;
+    const uint32_t n = (d < 31) ? (1u << (d + 1)) - 1 : 0;
+    const int      r = (f & HIPPO_REBASE) ? IMAGE_CENT : 0;
+
+    hippo   *H = NULL;
+    dstar   *D = NULL;
+    FILE    *stream;
+    size_t   m;
+    uint32_t c;
+    int      stat = 0;
+
+    if (n && (stream = fopen(filename, "r")))
+    {
+        if ((m = parse_count(stream, p)) > 0 &&
+            (H = (hippo *) calloc(sizeof (hippo), 1)) &&
+            riff_alloc(H, m, n, IMAGE_STAR | IMAGE_AGGR | IMAGE_CRCS | r))
+        {
+            c = (uint32_t) m;
+
+            if (r == 0)
+                stat = (parse_read(stream, p, H->stars, sizeof (star), c) == c &&
+                        mkindex(H->nodes, d, H->stars, sizeof (star), c, f) == n);
+
+            else if ((D = (dstar *) malloc(c * sizeof (dstar))) &&
+                     parse_read(stream, p, D, sizeof (dstar), c) == c &&
+                     mkindex(H->nodes, d, D, sizeof (dstar), c, f) == n)
+            {
+                rebase(H, D);
+                stat = 1;
+            }
+        }
+        fclose(stream);
+    }
+    free(D);
+
+    if (stat)
+    {
+        mkaggr(H->aggrs, H->nodes, H->nodec, H->stars, H->cents);
+        mkzone(H->zones, H->nodes, H->nodec, H->stars);
+        riff_seal(H);
+        return H;
+    }
+    hippo_free(H);
+    return NULL;
+}
+
+// Read a catalog in Hipparcos format and generate its index.
+
+hippo *hippo_read_hip(const char *filename, uint32_t d)
+{
+    return hippo_read_dat(filename, d, 0);
+}
+
+// Read a catalog in Tycho-2 format and generate its index.
+
+hippo *hippo_read_tyc(const char *filename, uint32_t d)
+{
+    return hippo_read_dat(filename, d, HIPPO_TYC);
+}
+
+//-----------------------------------------------------------------------------
+
+// Return the median of a sample of the i-coordinates of stars s0 through s1.
+
+static int float_cmp(const void *a, const void *b)
+{
+    return (*(const float *) a < *(const float *) b) ? -1 :
+           (*(const float *) a > *(const float *) b) ? +1 : 0;
+}
+
+static float sample(const star *S, uint32_t s0, uint32_t s1, uint32_t i)
+{
+    float    v[255];
+    uint32_t n = (s1 - s0 < 255) ? s1 - s0 : 255;
+
+    for (uint32_t k = 0; k < n; k++)
+        v[k] = S[s0 + (uint32_t) ((uint64_t) (s1 - s0) * k / n)].pos[i];
+
+    qsort(v, n, sizeof (float), float_cmp);
+
+    return v[n / 2];
+}
+
+// Rearrange stars s0 through s1 so that those with i-coordinate less than p
+// (or, if e, less than or equal to p) precede all others. Return the index of
+// the first of the others. The two cursors sweep the range sequentially from
+// either end, so this pass is efficient on a file mapping much larger than
+// physical memory.
+
+static uint32_t divide(star *S, uint32_t s0, uint32_t s1, uint32_t i,
+                       float p, int e)
+{
+    uint32_t a = s0;
+    uint32_t b = s1;
+
+    for (;;)
+    {
+        while (a < b && (S[a].pos[i] < p || (e && S[a].pos[i] == p))) a++;
+        while (a < b && (S[b - 1].pos[i] > p || (!e && S[b - 1].pos[i] == p))) b--;
+
+        if (a < b)
+        {
+            star t   = S[a];
+            S[a]     = S[b - 1];
+            S[b - 1] = t;
+        }
+        else return a;
+    }
+}
+
+// Rearrange stars s0 through s1 such that none preceding sm has i-coordinate
+// greater than sm and none following has i-coordinate less. Partition the
+// range by sampled pivots until the portion containing sm fits within the
+// buffer B of m stars, then select within that portion in memory.
+
+static void bisect(star *S, uint32_t s0, uint32_t s1, uint32_t sm,
+                   uint32_t i, star *B, uint32_t m)
+{
+    while (s1 - s0 > m)
+    {
+        float    p = sample(S, s0, s1, i);
+        uint32_t a = divide(S, s0, s1, i, p, 0);
+        uint32_t b = divide(S, a,  s1, i, p, 1);
+
+        if      (sm < a) s1 = a;
+        else if (sm < b) return;
+        else             s0 = b;
+    }
+
+    memcpy(B, S + s0, (s1 - s0) * sizeof (star));
+    select_axis(B, sizeof (star), 0, s1 - s0, sm - s0, i);
+    memcpy(S + s0, B, (s1 - s0) * sizeof (star));
+}
+
+// Recursively partition the stars of a file mapping into a BSP, as mknode
+// does, but using no more than the m-star buffer B. Any subtree whose stars
+// fit within the buffer is built there by mknode and copied back.
+
+static uint32_t mknode_ooc(node *N, uint32_t n0, uint32_t n1, uint32_t d,
+                           star *S, uint32_t s0, uint32_t s1, uint32_t i,
+                           star *B, uint32_t m)
+{
+    if (s1 - s0 <= m)
+    {
+        uint32_t n;
+
+        memcpy(B, S + s0, (s1 - s0) * sizeof (star));
+        n = mknode(N, n0, n1, d, B, sizeof (star), 0, s1 - s0, i);
+        memcpy(S + s0, B, (s1 - s0) * sizeof (star));
+
+        // Offset the new nodes to the position of this range in the file.
+
+        N[n0].star0 += s0;
+
+        for (uint32_t k = n1; k < n; k++)
+            N[k].star0 += s0;
+
+        return n;
+    }
+
+    N[n0].starc = s1 - s0;
+    N[n0].star0 = s0;
+
+    if (d > 0)
+    {
+        uint32_t sm = (s1 + s0) / 2;
+
+        bisect(S, s0, s1, sm, i, B, m);
+
+        N[n0].nodeL = n1++;
+        N[n0].nodeR = n1++;
+
+        n1 = mknode_ooc(N, N[n0].nodeL, n1, d - 1, S, s0, sm, (i + 1) % 3, B, m);
+        n1 = mknode_ooc(N, N[n0].nodeR, n1, d - 1, S, sm, s1, (i + 1) % 3, B, m);
+
+        N[n0].bound[0] = min(N[N[n0].nodeL].bound[0], N[N[n0].nodeR].bound[0]);
+        N[n0].bound[1] = min(N[N[n0].nodeL].bound[1], N[N[n0].nodeR].bound[1]);
+        N[n0].bound[2] = min(N[N[n0].nodeL].bound[2], N[N[n0].nodeR].bound[2]);
+        N[n0].bound[3] = max(N[N[n0].nodeL].bound[3], N[N[n0].nodeR].bound[3]);
+        N[n0].bound[4] = max(N[N[n0].nodeL].bound[4], N[N[n0].nodeR].bound[4]);
+        N[n0].bound[5] = max(N[N[n0].nodeL].bound[5], N[N[n0].nodeR].bound[5]);
+    }
+    else
+    {
+        N[n0].nodeL = 0;
+        N[n0].nodeR = 0;
+
+        N[n0].bound[0] = N[n0].bound[3] = S[s0].pos[0];
+        N[n0].bound[1] = N[n0].bound[4] = S[s0].pos[1];
+        N[n0].bound[2] = N[n0].bound[5] = S[s0].pos[2];
+
+        for (uint32_t s = s0; s < s1; s++)
+        {
+            N[n0].bound[0] = min(N[n0].bound[0], S[s].pos[0]);
+            N[n0].bound[1] = min(N[n0].bound[1], S[s].pos[1]);
+            N[n0].bound[2] = min(N[n0].bound[2], S[s].pos[2]);
+            N[n0].bound[3] = max(N[n0].bound[3], S[s].pos[0]);
+            N[n0].bound[4] = max(N[n0].bound[4], S[s].pos[1]);
+            N[n0].bound[5] = max(N[n0].bound[5], S[s].pos[2]);
+        }
+    }
+    return n1;
+}
+
+// Parse the named input file with the given record parser and build its RIFF
+// directly within a shared mapping of a temporary file beside the named output
+// file. The stars never reside in process memory, except for an m-byte working
+// buffer. Once complete, flush the file and rename it over the output, as does
+// hippo_write, so that readers mapping the old file are unaffected and a
+// failed build leaves it intact.
+
+static int make_dat(const char *in, const char *out, uint32_t d, size_t m, int a,
+                    parse_fn parse)
+{
+    FILE *stream;
+    char *temp;
+    int   stat = 0;
+    int   fd;
+
+    if ((temp = (char *) malloc(strlen(out) + 8)) == NULL)
+        return 0;
+
+    sprintf(temp, "%s.XXXXXX", out);
+
+    if ((stream = fopen(in, "r")))
+    {
+        // Make a pass over the input to determine the number of records.
+
+        char   buf[MAXRECLEN];
+        size_t n = 0;
+        star   s;
+
+        while (fgets(buf, MAXRECLEN, stream))
+            n += parse(&s, NULL, buf);
+
+        rewind(stream);
+
+        // Size the output file. Chunk and RIFF lengths are 32-bit, so refuse
+        // a catalog whose RIFF body would exceed 4 GB, before touching the
+        // output, rather than truncate its lengths.
+
+        const size_t k = (d < 31) ? ((size_t) 1 << (d + 1)) - 1 : 0;
+
+        size_t stars = n * sizeof (star);
+        size_t nodes = k * sizeof (node);
+        size_t aggrs = a ? k * sizeof (aggr) : 0;
+        size_t zones = k * 6 * sizeof (float);
+        size_t crcs  = aggrs ? 32 : 24;
+        size_t body  = 8 + stars + 8 + nodes + (aggrs ? 8 + aggrs : 0)
+                     + 8 + zones + 8 + crcs;
+        size_t len   = 8 + body;
+
+        if (n && k && body <= UINT32_MAX && (fd = mkstemp(temp)) != -1)
+        {
+            uint32_t *p;
+            star     *B;
+
+            if (fchmod(fd, file_mode(out)) == 0 && ftruncate(fd, (off_t) len) == 0)
+            {
+                p = (uint32_t *) mmap(0, len, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED, fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    star *S = (star *) (p + 4);
+                    node *N = (node *) (p + 6 + stars / 4);
+                    aggr *A = (aggr *) (p + 8 + stars / 4 + nodes / 4);
+                    uint32_t c = 0;
+
+                    // Stream all records into the mapping.
+
+                    while (fgets(buf, MAXRECLEN, stream) && c < n)
+                        c += parse(S + c, NULL, buf);
+
+                    // Build the index within the buffer budget.
+
+                    m = (m / sizeof (star) > 1024) ? m / sizeof (star) : 1024;
+
+                    if (c == n && (B = (star *) malloc(m * sizeof (star))))
+                    {
+                        mknode_ooc(N, 0, 1, d, S, 0, (uint32_t) n, 0, B, (uint32_t) m);
+                        free(B);
+
+                        p[0] = fourcc("RIFF");
+                        p[1] = (uint32_t) (stars + nodes + 16);
+                        p[2] = fourcc("STAR");
+                        p[3] = (uint32_t) stars;
+                        p[4 + stars / 4] = fourcc("NODE");
+                        p[5 + stars / 4] = (uint32_t) nodes;
+
+                        if (aggrs)
+                        {
+                            mkaggr(A, N, (uint32_t) k, S, NULL);
+
+                            p[1] += (uint32_t) (aggrs + 8);
+                            p[6 + stars / 4 + nodes / 4] = fourcc("AGGR");
+                            p[7 + stars / 4 + nodes / 4] = (uint32_t) aggrs;
+                        }
+
+                        // Append the zones after any aggregates.
+
+                        uint32_t *z = p + 2 + p[1] / 4;
+
+                        z[0] = fourcc("ZONE");
+                        z[1] = (uint32_t) zones;
+                        mkzone((float *) (z + 2), N, (uint32_t) k, S);
+                        p[1] += (uint32_t) (zones + 8);
+
+                        // Checksum the chunks in the order written.
+
+                        uint32_t *x = p + 2 + p[1] / 4;
+
+                        x[0] = fourcc("CRCS");
+                        x[1] = (uint32_t) crcs;
+                        x[2] = fourcc("STAR");
+                        x[3] = crc_par(S, stars);
+                        x[4] = fourcc("NODE");
+                        x[5] = crc_par(N, nodes);
+
+                        if (aggrs)
+                        {
+                            x[6] = fourcc("AGGR");
+                            x[7] = crc_par(A, aggrs);
+                        }
+                        x[crcs / 4    ] = fourcc("ZONE");
+                        x[crcs / 4 + 1] = crc_par(z + 2, zones);
+
+                        p[1] += (uint32_t) (crcs + 8);
+
+                        stat = (msync(p, len, MS_SYNC) == 0);
+                    }
+                    munmap(p, len);
+                }
+            }
+            stat = stat && fsync(fd) == 0;
+
+            if (close(fd) || !stat || rename(temp, out))
+            {
+                unlink(temp);
+                stat = 0;
+            }
+            else stat = sync_dir(out);
+        }
+        fclose(stream);
+    }
+    free(temp);
+    return stat;
+}
+
+// Read a catalog in Hipparcos format and write it and its index to a RIFF
+// using no more than m bytes of working memory. Include aggregates if a.
+
+int hippo_make_hip(const char *in, const char *out, uint32_t d, size_t m, int a)
+{
+    return make_dat(in, out, d, m, a, parse_hip);
+}
+
+// Read a catalog in Tycho-2 format and write it and its index to a RIFF
+// using no more than m bytes of working memory. Include aggregates if a.
+
+int hippo_make_tyc(const char *in, const char *out, uint32_t d, size_t m, int a)
+{
+    return make_dat(in, out, d, m, a, parse_tyc);
+}
+
+//-----------------------------------------------------------------------------
+
+// A view job evaluates the filter of a view over the leaves n0 through n1 of
+// its parent, marking each selected star and counting the runs of selected
+// stars within each leaf.
+
+#define VIEW_JOBS 64
+
+struct view_job
+{
+    const hippo  *H;
+    hippo_view_fn fn;
+    uint8_t      *sel;
+    uint32_t     *runs;
+    uint32_t      n0;
+    uint32_t      n1;
+};
+
+static void *view_work(void *data)
+{
+    struct view_job *j = (struct view_job *) data;
+    const node      *N = j->H->nodes;
+    float            o[3];
+    star             u;
+
+    for (uint32_t n = j->n0; n < j->n1; n++)
+        if (N[n].nodeL == 0 || N[n].nodeR == 0)
+        {
+            uint32_t r = 0;
+            uint8_t  p = 0;
+
+            node_offset(j->H->cents, n, o);
+
+            for (uint32_t s = N[n].star0; s < N[n].star0 + N[n].starc; s++)
+            {
+                uint8_t k = j->fn(star_at(&u, j->H->stars + s, o)) ? 1 : 0;
+
+                if (k && !p) r++;
+                j->sel[s] = p = k;
+            }
+            j->runs[n] = r;
+        }
+    return NULL;
+}
+
+// Evaluate the filter over all leaves in up to one job per processor.
+
+static void view_par(const hippo *H, hippo_view_fn fn, uint8_t *sel,
+                                                       uint32_t *runs)
+{
+    struct view_job J[VIEW_JOBS];
+    pthread_t       T[VIEW_JOBS];
+    int             s[VIEW_JOBS];
+    long            t = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t        b;
+    int             k;
+
+    t = (t < 1) ? 1 : (t > VIEW_JOBS) ? VIEW_JOBS : t;
+    b = (uint32_t) ((H->nodec + t - 1) / t);
+
+    // Start a thread for each block of nodes after the first, and do the
+    // first here.
+
+    for (k = 0; (uint32_t) k * b < H->nodec; k++)
+    {
+        J[k].H    = H;
+        J[k].fn   = fn;
+        J[k].sel  = sel;
+        J[k].runs = runs;
+        J[k].n0   = k * b;
+        J[k].n1   = (H->nodec - k * b < b) ? H->nodec : k * b + b;
+
+        if (k)
+            s[k] = pthread_create(T + k, NULL, view_work, J + k);
+    }
+    view_work(J);
+
+    for (int i = 1; i < k; i++)
+        if (s[i] == 0)
+            pthread_join(T[i], NULL);
+        else
+            view_work(J + i);
+}
+
+// The view builder gives the parent catalog H and view V, the star selection,
+// the node count of the view subtree of each parent node, and the bounds of
+// the runs of the current leaf.
+
+struct view_build
+{
+    const hippo    *H;
+    hippo          *V;
+    const uint8_t  *sel;
+    const uint32_t *size;
+    uint32_t       *r0;
+    uint32_t       *r1;
+};
+
+// Build a balanced subtree over runs r0 through r1 of a parent leaf at view
+// node k, in pre-order so that children follow their parents, with node
+// bounds refit to the stars of each run at offset o.
+
+static void view_runs(struct view_build *B, uint32_t p, uint32_t r0,
+                      uint32_t r1, uint32_t k, const float *o)
+{
+    node *N = B->V->nodes + k;
+
+    if (r1 - r0 == 1)
+    {
+        N->star0 = B->r0[r0];
+        N->starc = B->r1[r0] - B->r0[r0];
+        N->nodeL = 0;
+        N->nodeR = 0;
+
+        star_bound(N->bound, B->H->stars, sizeof (star), B->r0[r0], B->r1[r0]);
+
+        N->bound[0] += o[0]; N->bound[3] += o[0];
+        N->bound[1] += o[1]; N->bound[4] += o[1];
+        N->bound[2] += o[2]; N->bound[5] += o[2];
+
+        if (B->V->cents)
+            memcpy((double *) B->V->cents + k * 3,
+             (const double *) B->H->cents + p * 3, 3 * sizeof (double));
+    }
+    else
+    {
+        const uint32_t rm = (r0 + r1) / 2;
+
+        N->nodeL = k + 1;
+        N->nodeR = k + 2 * (rm - r0);
+
+        view_runs(B, p, r0, rm, N->nodeL, o);
+        view_runs(B, p, rm, r1, N->nodeR, o);
+
+        const node *L = B->V->nodes + N->nodeL;
+        const node *R = B->V->nodes + N->nodeR;
+
+        N->star0 = L->star0;
+        N->starc = R->star0 + R->starc - L->star0;
+
+        N->bound[0] = min(L->bound[0], R->bound[0]);
+        N->bound[1] = min(L->bound[1], R->bound[1]);
+        N->bound[2] = min(L->bound[2], R->bound[2]);
+        N->bound[3] = max(L->bound[3], R->bound[3]);
+        N->bound[4] = max(L->bound[4], R->bound[4]);
+        N->bound[5] = max(L->bound[5], R->bound[5]);
+    }
+}
+
+// Build the view subtree of parent node p at view node k. A parent node with
+// one empty subtree collapses into the other.
+
+static void view_node(struct view_build *B, uint32_t p, uint32_t k)
+{
+    const node *P = B->H->nodes + p;
+
+    if (P->nodeL == 0 || P->nodeR == 0)
+    {
+        uint32_t c = 0;
+        float    o[3];
+
+        for (uint32_t s = P->star0; s < P->star0 + P->starc; s++)
+            if (B->sel[s] && (s == P->star0 || !B->sel[s - 1]))
+                B->r0[c++] = s;
+            else if (!B->sel[s] && s > P->star0 && B->sel[s - 1])
+                B->r1[c - 1] = s;
+
+        if (c && B->sel[P->star0 + P->starc - 1])
+            B->r1[c - 1] = P->star0 + P->starc;
+
+        node_offset(B->H->cents, p, o);
+        view_runs(B, p, 0, c, k, o);
+    }
+    else
+    {
+        const uint32_t l = B->size[P->nodeL];
+        const uint32_t r = B->size[P->nodeR];
+
+        if (l && r)
+        {
+            node *N = B->V->nodes + k;
+
+            N->nodeL = k + 1;
+            N->nodeR = k + 1 + l;
+
+            view_node(B, P->nodeL, N->nodeL);
+            view_node(B, P->nodeR, N->nodeR);
+
+            const node *L = B->V->nodes + N->nodeL;
+            const node *R = B->V->nodes + N->nodeR;
+
+            N->star0 = L->star0;
+            N->starc = R->star0 + R->starc - L->star0;
+
+            N->bound[0] = min(L->bound[0], R->bound[0]);
+            N->bound[1] = min(L->bound[1], R->bound[1]);
+            N->bound[2] = min(L->bound[2], R->bound[2]);
+            N->bound[3] = max(L->bound[3], R->bound[3]);
+            N->bound[4] = max(L->bound[4], R->bound[4]);
+            N->bound[5] = max(L->bound[5], R->bound[5]);
+        }
+        else if (l) view_node(B, P->nodeL, k);
+        else        view_node(B, P->nodeR, k);
+    }
+}
+
+// Return the length of the star array of catalog H. A view shares the array
+// of its parent, while its own count covers only the stars it selects.
+
+static uint32_t view_span(const hippo *H)
+{
+    while (H->parent)
+        H = H->parent;
+
+    return H->starc;
+}
+
+// Derive from catalog H a view of those of its stars for which fn returns
+// nonzero, given each star in the frame of the catalog. The view shares the
+// stars of H, which must outlive it, and indexes them with nodes of its own,
+// each leaf of which lists one run of consecutive selected stars. The view
+// counts only those stars.
+
+hippo *hippo_view(const hippo *H, hippo_view_fn fn)
+{
+    struct view_build B;
+
+    const uint32_t c = view_span(H);
+
+    hippo    *V    = NULL;
+    uint8_t  *sel  = (uint8_t  *) calloc(c ? c : 1, 1);
+    uint32_t *runs = (uint32_t *) calloc(H->nodec ? H->nodec : 1, sizeof (uint32_t));
+    uint32_t *size = (uint32_t *) calloc(H->nodec ? H->nodec : 1, sizeof (uint32_t));
+    uint32_t  m    = 0;
+    int       stat = 0;
+
+    B.r0 = NULL;
+    B.r1 = NULL;
+
+    if (sel && runs && size && H->nodec && (V = (hippo *) calloc(sizeof (hippo), 1)))
+    {
+        view_par(H, fn, sel, runs);
+
+        // Count the nodes of the view subtree of each node, children first.
+
+        for (uint32_t n = H->nodec; n-- > 0; )
+        {
+            const node *N = H->nodes + n;
+
+            if (N->nodeL == 0 || N->nodeR == 0)
+            {
+                size[n] = runs[n] ? 2 * runs[n] - 1 : 0;
+                m       = (m < runs[n]) ? runs[n] : m;
+            }
+            else
+            {
+                const uint32_t l = size[N->nodeL];
+                const uint32_t r = size[N->nodeR];
+
+                size[n] = (l && r) ? 1 + l + r : l + r;
+            }
+        }
+
+        // The view is a single image of its own nodes and node data, without
+        // stars. An empty view has a single empty leaf.
+
+        B.H    = H;
+        B.V    = V;
+        B.sel  = sel;
+        B.size = size;
+        B.r0   = (uint32_t *) malloc((m + 1) * sizeof (uint32_t));
+        B.r1   = (uint32_t *) malloc((m + 1) * sizeof (uint32_t));
+
+        if (B.r0 && B.r1 && riff_alloc(V, 0, size[0] ? size[0] : 1,
+                                       (H->aggrs ? IMAGE_AGGR : 0) |
+                                       (H->cents ? IMAGE_CENT : 0)))
+        {
+            V->parent = H;
+            V->stars  = H->stars;
+            V->starc  = 0;
+
+            if (V->cents)
+                memset(V->cents, 0, V->nodec * 3 * sizeof (double));
+
+            if (size[0])
+                view_node(&B, 0, 0);
+            else
+                memset(V->nodes, 0, sizeof (node));
+
+            for (uint32_t n = 0; n < V->nodec; n++)
+                if (V->nodes[n].nodeL == 0 || V->nodes[n].nodeR == 0)
+                    V->starc += V->nodes[n].starc;
+
+            if (V->aggrs)
+                mkaggr(V->aggrs, V->nodes, V->nodec, V->stars, V->cents);
+
+            mkzone(V->zones, V->nodes, V->nodec, V->stars);
+            stat = 1;
+        }
+    }
+
+    free(B.r1);
+    free(B.r0);
+    free(size);
+    free(runs);
+    free(sel);
+
+    if (stat == 0)
+    {
+        hippo_free(V);
+        V = NULL;
+    }
+    return V;
+}
+
+//-----------------------------------------------------------------------------
+
+// Return the number of bounding box corners lying in front of plane v.
+
+static int plane_test(const float *b, const float *v)
+{
+    const float k00 = b[0] * v[0];
+    const float k11 = b[1] * v[1];
+    const float k22 = b[2] * v[2];
+    const float k30 = b[3] * v[0];
+    const float k41 = b[4] * v[1];
+    const float k52 = b[5] * v[2];
+
+    return (k00 + k11 + k22 + v[3] > 0 ? 1 : 0)
+         + (k00 + k11 + k52 + v[3] > 0 ? 1 : 0)
+         + (k00 + k41 + k22 + v[3] > 0 ? 1 : 0)
+         + (k00 + k41 + k52 + v[3] > 0 ? 1 : 0)
+         + (k30 + k11 + k22 + v[3] > 0 ? 1 : 0)
+         + (k30 + k11 + k52 + v[3] > 0 ? 1 : 0)
+         + (k30 + k41 + k22 + v[3] > 0 ? 1 : 0)
+         + (k30 + k41 + k52 + v[3] > 0 ? 1 : 0);
+}
+
+// Determine whether an axis-aligned bounding box b is outside-of, inside-of,
+// or split-by the set of c planes at v.
+
+static int bound_test(const float *b, const float *v, int c)
+{
+    int n, m = 0;
+
+    // If the box is entirely behind one of the planes, return -1.
+
+    for (int i = 0; i < c; i++)
+        if ((n = plane_test(b, v + i * 4)) == 0)
+            return -1;
+        else
+            m += n;
+
+    // If the box is entirely in front of all planes, return +1.
+
+    return (m == c * 8) ? 1 : 0;
+}
+
+// Classify box b as does bound_test, but count a corner lying on a plane as in
+// front of it, as point_test counts a star. A corner is on or in front of v
+// exactly when it is not in front of the negation of v.
+
+static int bound_test_closed(const float *b, const float *v, int c)
+{
+    int n, m = 0;
+
+    for (int i = 0; i < c; i++)
+    {
+        const float u[4] = { -v[i * 4 + 0], -v[i * 4 + 1],
+                             -v[i * 4 + 2], -v[i * 4 + 3] };
+
+        if ((n = 8 - plane_test(b, u)) == 0)
+            return -1;
+        else
+            m += n;
+    }
+    return (m == c * 8) ? 1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+
+// Append the range of c stars beginning at star i to list L. If m, extend the
+// last range instead, if this one immediately follows it. BSP siblings are
+// stored contiguously, so this merges most of the ranges produced by a query.
+
+static int list_add(hippo_list *L, uint32_t i, uint32_t c, int m)
+{
+    if (m && L->c && (uint32_t) (L->first[L->c - 1] + L->count[L->c - 1]) == i)
+    {
+        L->count[L->c - 1] += (int) c;
+        return 1;
+    }
+    if (L->c == L->n)
+    {
+        uint32_t n = L->n ? L->n * 2 : 256;
+        int     *f;
+        int     *k;
+
+        if ((f = (int *) realloc(L->first, n * sizeof (int)))) L->first = f;
+        if ((k = (int *) realloc(L->count, n * sizeof (int)))) L->count = k;
+
+        if (f && k)
+            L->n = n;
+        else
+            return 0;
+    }
+    L->first[L->c] = (int) i;
+    L->count[L->c] = (int) c;
+    L->c++;
+    return 1;
+}
+
+// Append a range to list L, merging it with the last where possible.
+
+int hippo_list_append(hippo_list *L, uint32_t i, uint32_t c)
+{
+    return list_add(L, i, c, 1);
+}
+
+// Append a range of the stars of catalog H to list L. Do not merge the ranges
+// of a rebased catalog, so that each lies within a single leaf.
+
+static int list_stars(const hippo *H, hippo_list *L, uint32_t i, uint32_t c)
+{
+    return list_add(L, i, c, H->cents == NULL);
+}
+
+// Release the storage of list L, leaving it empty.
+
+void hippo_list_free(hippo_list *L)
+{
+    free(L->first);
+    free(L->count);
+
+    L->first = NULL;
+    L->count = NULL;
+    L->c     = 0;
+    L->n     = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+// Return nonzero if a node wholly inside a query may be listed whole. The
+// stars of a node of a view are not contiguous, and those of a node of a
+// rebased catalog do not share one frame, so each of these is listed leaf by
+// leaf, and any listed range lies within a single leaf.
+
+static inline int whole(const hippo *H)
+{
+    return H->parent == NULL && H->cents == NULL;
+}
+
+// A visitor receives each node found by a traversal of catalog H.
+
+typedef void (*visit_fn)(const hippo *H, const node *N, void *data);
+
+// Call fn with each leaf beneath node n, as for a node wholly inside the
+// planes that may not be listed whole.
+
+static void traverse_in(const hippo *H, visit_fn fn, void *data, uint32_t n)
+{
+    if (H->nodes[n].nodeL == 0 || H->nodes[n].nodeR == 0)
+        fn(H, H->nodes + n, data);
+    else
+    {
+        traverse_in(H, fn, data, H->nodes[n].nodeL);
+        traverse_in(H, fn, data, H->nodes[n].nodeR);
+    }
+}
+
+// Traverse the node hierarchy. Call fn with each node whose stars fall
+// within the set of c planes at v. Node n lies at depth d.
+
+static void traverse(const hippo *H, const float *v, int c,
+                     visit_fn fn, void *data, uint32_t n, uint32_t d)
+{
+    int r = bound_test(H->nodes[n].bound, v, c);
+
+    if (r >= 0)
+    {
+        if (H->pages && d == H->pages->k)
+            page_touch(H, n);
+
+        if ((r > 0 && whole(H)) || H->nodes[n].nodeL == 0
+                                || H->nodes[n].nodeR == 0)
+        {
+            if (H->pages && d < H->pages->k)
+                page_range(H, n, d);
+
+            fn(H, H->nodes + n, data);
+        }
+        else if (r > 0)
+            traverse_in(H, fn, data, n);
+        else
+        {
+            traverse(H, v, c, fn, data, H->nodes[n].nodeL, d + 1);
+            traverse(H, v, c, fn, data, H->nodes[n].nodeR, d + 1);
+        }
+    }
+}
+
+static void visit_seek(const hippo *H, const node *N, void *data)
+{
+    (*(hippo_seek_fn *) data)(H->stars + N->star0, N->starc);
+}
+
+// A list query gathers ranges into list L, noting any failure to append.
+
+struct listq
+{
+    hippo_list *L;
+    int         stat;
+};
+
+typedef struct listq listq;
+
+static void visit_list(const hippo *H, const node *N, void *data)
+{
+    listq *Q = (listq *) data;
+
+    (void) H;
+
+    if (Q->stat && list_stars(H, Q->L, N->star0, N->starc) == 0)
+        Q->stat = 0;
+}
+
+// Call fn with each list of stars that falls within the set of c planes at v.
+
+void hippo_seek(const hippo *H, const float *v, int c, hippo_seek_fn fn)
+{
+    traverse(H, v, c, visit_seek, &fn, 0, 0);
+}
+
+// Gather the ranges of stars that fall within the set of c planes at v into
+// list L, replacing its previous contents. Return 0 on failure to extend the
+// list, leaving it empty rather than incomplete.
+
+int hippo_seek_list(const hippo *H, const float *v, int c, hippo_list *L)
+{
+    listq Q = { L, 1 };
+
+    L->c = 0;
+    traverse(H, v, c, visit_list, &Q, 0, 0);
+
+    if (Q.stat == 0)
+        L->c = 0;
+
+    return Q.stat;
+}
+
+// Traverse the node hierarchy, as does traverse, with the set of c planes at v
+// given relative to observer o. Test each node bound relative to o, and so in
+// the precision of the observer's neighborhood. Call fn with each list of
+// stars and the center of the node they are relative to: each leaf of a
+// rebased catalog, or any node of an absolute catalog, relative to the origin.
+
+static void traverse_at(const hippo *H, const double *o, const float *v, int c,
+                        hippo_seek_at_fn fn, uint32_t n, uint32_t d, int r)
+{
+    const node *N = H->nodes + n;
+    double      p[3];
+    float       b[6];
+
+    if (r == 0)
+    {
+        b[0] = (float) (N->bound[0] - o[0]);
+        b[1] = (float) (N->bound[1] - o[1]);
+        b[2] = (float) (N->bound[2] - o[2]);
+        b[3] = (float) (N->bound[3] - o[0]);
+        b[4] = (float) (N->bound[4] - o[1]);
+        b[5] = (float) (N->bound[5] - o[2]);
+
+        r = bound_test(b, v, c);
+    }
+
+    if (r >= 0)
+    {
+        if (H->pages && d == H->pages->k)
+            page_touch(H, n);
+
+        if ((r > 0 && whole(H)) || N->nodeL == 0 || N->nodeR == 0)
+        {
+            if (H->pages && d < H->pages->k)
+                page_range(H, n, d);
+
+            node_center(H->cents, n, p);
+            fn(H->stars + N->star0, N->starc, p);
+        }
+        else
+        {
+            traverse_at(H, o, v, c, fn, N->nodeL, d + 1, r);
+            traverse_at(H, o, v, c, fn, N->nodeR, d + 1, r);
+        }
+    }
+}
+
+// Call fn with each list of stars that falls within the set of c planes at v,
+// given relative to the observer at o, along with the center of the frame of
+// the list.
+
+void hippo_seek_at(const hippo *H, const double *o,
+                   const float *v, int c, hippo_seek_at_fn fn)
+{
+    traverse_at(H, o, v, c, fn, 0, 0, 0);
+}
+
+// Level-of-detail query parameters: the bounding planes, the projection, the
+// viewport width, the pixel threshold, and the call-backs.
+
+struct lod
+{
+    const float  *v;
+    int           c;
+    const float  *M;
+    float         w;
+    float         t;
+    float         k0;
+    float         k3;
+    hippo_seek_fn fn;
+    hippo_aggr_fn af;
+};
+
+typedef struct lod lod;
+
+// Return the projected size in pixels of the bounding sphere of box b, or
+// infinity if any part of that sphere lies behind the viewer.
+
+static float lod_size(const lod *L, const float *b)
+{
+    const float x = (b[0] + b[3]) * 0.5f;
+    const float y = (b[1] + b[4]) * 0.5f;
+    const float z = (b[2] + b[5]) * 0.5f;
+
+    const float r = 0.5f * (float) sqrt((b[3] - b[0]) * (b[3] - b[0]) +
+                                        (b[4] - b[1]) * (b[4] - b[1]) +
+                                        (b[5] - b[2]) * (b[5] - b[2]));
+
+    const float d = L->M[12] * x + L->M[13] * y + L->M[14] * z + L->M[15]
+                  - r * L->k3;
+
+    return (d > 0) ? r * L->k0 * L->w / d : HUGE_VALF;
+}
+
+// Traverse the node hierarchy as does traverse, but substitute the aggregate
+// of any node that projects smaller than the threshold. Continue to descend
+// through nodes wholly inside the planes, as their children may be smaller.
+
+static void traverse_lod(const hippo *H, const lod *L,
+                         uint32_t n, uint32_t d, int r)
+{
+    const node *N = H->nodes + n;
+
+    if (r == 0)
+        r = bound_test(N->bound, L->v, L->c);
+
+    if (r >= 0 && N->starc)
+    {
+        if (H->pages && d == H->pages->k)
+            page_touch(H, n);
+
+        if (lod_size(L, N->bound) < L->t)
+            L->af(H->aggrs + n);
+
+        else if (N->nodeL == 0 || N->nodeR == 0)
+        {
+            if (H->pages && d < H->pages->k)
+                page_range(H, n, d);
+
+            L->fn(H->stars + N->star0, N->starc);
+        }
+        else
+        {
+            traverse_lod(H, L, N->nodeL, d + 1, r);
+            traverse_lod(H, L, N->nodeR, d + 1, r);
+        }
+    }
+}
+
+// Call fn with each list of stars that falls within the set of c planes at v,
+// as does hippo_seek. However, call af with the aggregate photometry of any
+// subtree whose bound, under model-view-projection M, projects smaller than
+// t pixels within a viewport w pixels wide. Lacking aggregates, seek.
+
+void hippo_seek_lod(const hippo *H, const float *v, int c,
+                    const float *M, float w, float t,
+                    hippo_seek_fn fn, hippo_aggr_fn af)
+{
+    if (H->aggrs)
+    {
+        lod L;
+
+        L.v  = v;
+        L.c  = c;
+        L.M  = M;
+        L.w  = w * 0.5f;
+        L.t  = t;
+        L.fn = fn;
+        L.af = af;
+
+        // Note the scale of the X and W rows of the projection.
+
+        L.k0 = (float) sqrt(M[ 0] * M[ 0] + M[ 1] * M[ 1] + M[ 2] * M[ 2]);
+        L.k3 = (float) sqrt(M[12] * M[12] + M[13] * M[13] + M[14] * M[14]);
+
+        traverse_lod(H, &L, 0, 0, 0);
+    }
+    else hippo_seek(H, v, c, fn);
+}
+
+// Determine whether point p lies within the set of c planes at v.
+
+static int point_test(const float *p, const float *v, int c)
+{
+    for (int i = 0; i < c; i++, v += 4)
+        if (p[0] * v[0] + p[1] * v[1] + p[2] * v[2] + v[3] < 0)
+            return 0;
+
+    return 1;
+}
+
+// Merge into a the aggregate of all stars of node n lying within the set of c
+// planes at v. Use the precomputed aggregate of any node wholly inside, and
+// test individual stars only at straddling leaves. Nodes are classified with
+// closed planes, so that a star on a plane counts as within, as for
+// point_test.
+
+static void total(const hippo *H, const float *v, int c,
+                  aggr *a, uint32_t n, int r)
+{
+    const node *N = H->nodes + n;
+    aggr        t;
+    star        u;
+    float       o[3];
+
+    if (r == 0)
+        r = bound_test_closed(N->bound, v, c);
+
+    if (r > 0 && H->aggrs)
+        aggr_merge(a, H->aggrs + n);
+
+    else if (r >= 0)
+    {
+        if (N->nodeL == 0 || N->nodeR == 0)
+        {
+            if (H->pages)
+                page_node(H, n);
+
+            node_offset(H->cents, n, o);
+
+            for (uint32_t s = N->star0; s < N->star0 + N->starc; s++)
+                if (r > 0 || point_test(star_at(&u, H->stars + s, o)->pos, v, c))
+                {
+                    aggr_star (&t, star_at(&u, H->stars + s, o));
+                    aggr_merge(a, &t);
+                }
+        }
+        else
+        {
+            total(H, v, c, a, N->nodeL, r);
+            total(H, v, c, a, N->nodeR, r);
+        }
+    }
+}
+
+// Count the stars of node n lying within the set of c planes at v with V
+// magnitude no greater than m. Prune nodes having no star so bright, and
+// count nodes wholly inside having no star fainter. Nodes are classified as
+// for total.
+
+static uint32_t count(const hippo *H, const float *v, int c,
+                      float m, uint32_t n, int r)
+{
+    const node *N = H->nodes + n;
+    const aggr *A = H->aggrs ? H->aggrs + n : NULL;
+    uint32_t    k = 0;
+    star        u;
+    float       o[3];
+
+    if (A && (A->count == 0 || A->vmin > m))
+        return 0;
+
+    if (r == 0)
+        r = bound_test_closed(N->bound, v, c);
+
+    if (r > 0 && A && A->vmax <= m)
+        return A->count;
+
+    if (r >= 0)
+    {
+        if (N->nodeL == 0 || N->nodeR == 0)
+        {
+            if (H->pages)
+                page_node(H, n);
+
+            node_offset(H->cents, n, o);
+
+            for (uint32_t s = N->star0; s < N->star0 + N->starc; s++)
+                if (H->stars[s].mag[1] <= m)
+                    if (r > 0 || point_test(star_at(&u, H->stars + s, o)->pos, v, c))
+                        k++;
+        }
+        else
+        {
+            k += count(H, v, c, m, N->nodeL, r);
+            k += count(H, v, c, m, N->nodeR, r);
+        }
+    }
+    return k;
+}
+
+// Compute the aggregate photometry of all stars within the set of c planes
+// at v.
+
+void hippo_total(const hippo *H, const float *v, int c, aggr *a)
+{
+    memset(a, 0, sizeof (aggr));
+    total(H, v, c, a, 0, 0);
+}
+
+// Count the stars within the set of c planes at v with V magnitude no
+// greater than m.
+
+uint32_t hippo_count(const hippo *H, const float *v, int c, float m)
+{
+    return count(H, v, c, m, 0, 0);
+}
+
+// Cone query parameters: the apex, the unit axis, the half-angle, and its
+// cosine, the magnitude limit, and the call-back.
+
+struct cone
+{
+    float         p[3];
+    float         d[3];
+    float         a;
+    float         k;
+    float         m;
+    hippo_seek_fn fn;
+};
+
+typedef struct cone cone;
+
+// Test the bounding sphere of box b against cone K. Return -1 if it lies
+// wholly outside, +1 if wholly inside, and 0 otherwise.
+
+static int cone_test(const float *b, const cone *K)
+{
+    const float w[3] = {
+        (b[0] + b[3]) * 0.5f - K->p[0],
+        (b[1] + b[4]) * 0.5f - K->p[1],
+        (b[2] + b[5]) * 0.5f - K->p[2],
+    };
+    const float e[3] = {
+        (b[3] - b[0]) * 0.5f,
+        (b[4] - b[1]) * 0.5f,
+        (b[5] - b[2]) * 0.5f,
+    };
+
+    float r = (float) sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+    float l = (float) sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+
+    // If the sphere contains the apex, it straddles the cone.
+
+    if (l <= r)
+        return 0;
+
+    // Compare the angle to the sphere center, give or take its angular radius.
+
+    float t = (w[0] * K->d[0] + w[1] * K->d[1] + w[2] * K->d[2]) / l;
+    float q = (float) acos(max(-1.0f, min(1.0f, t)));
+    float s = (float) asin(r / l);
+
+    if (q - s > K->a) return -1;
+    if (q + s < K->a) return +1;
+    return 0;
+}
+
+// Determine whether star s lies within cone K.
+
+static int cone_star(const star *s, const cone *K)
+{
+    const float w[3] = {
+        s->pos[0] - K->p[0],
+        s->pos[1] - K->p[1],
+        s->pos[2] - K->p[2],
+    };
+
+    float l = (float) sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+
+    return w[0] * K->d[0] + w[1] * K->d[1] + w[2] * K->d[2] >= l * K->k;
+}
+
+// Traverse the node hierarchy, calling the call-back with each run of stars
+// of node n within cone K and no fainter than its limit. Emit nodes wholly
+// inside having no star too faint whole, and test stars only at leaves.
+
+static void traverse_cone(const hippo *H, const cone *K,
+                          uint32_t n, uint32_t d, int r)
+{
+    const node *N = H->nodes + n;
+    const aggr *A = H->aggrs ? H->aggrs + n : NULL;
+
+    if (A && (A->count == 0 || A->vmin > K->m))
+        return;
+
+    if (r == 0)
+        r = cone_test(N->bound, K);
+
+    if (r >= 0)
+    {
+        if (H->pages && d == H->pages->k)
+            page_touch(H, n);
+
+        if (r > 0 && A && A->vmax <= K->m && whole(H))
+        {
+            if (H->pages && d < H->pages->k)
+                page_range(H, n, d);
+
+            K->fn(H->stars + N->star0, N->starc);
+        }
+        else if (N->nodeL == 0 || N->nodeR == 0)
+        {
+            uint32_t s0 = N->star0;
+            uint32_t s1 = N->star0 + N->starc;
+            uint32_t s, i = s0;
+            star     u;
+            float    o[3];
+
+            node_offset(H->cents, n, o);
+
+            for (s = s0; s < s1; s++)
+                if (H->stars[s].mag[1] > K->m ||
+                    (r == 0 && !cone_star(star_at(&u, H->stars + s, o), K)))
+                {
+                    if (i < s) K->fn(H->stars + i, s - i);
+                    i = s + 1;
+                }
+
+            if (i < s) K->fn(H->stars + i, s - i);
+        }
+        else
+        {
+            traverse_cone(H, K, N->nodeL, d + 1, r);
+            traverse_cone(H, K, N->nodeR, d + 1, r);
+        }
+    }
+}
+
+// Call fn with each run of stars within a degrees of unit direction d as seen
+// from p, with V magnitude no greater than m.
+
+void hippo_seek_cone(const hippo *H, const float *p, const float *d,
+                     float a, float m, hippo_seek_fn fn)
+{
+    cone K;
+
+    K.p[0] = p[0];
+    K.p[1] = p[1];
+    K.p[2] = p[2];
+    K.d[0] = d[0];
+    K.d[1] = d[1];
+    K.d[2] = d[2];
+    K.a    = (float) rad(a);
+    K.k    = (float) cos(rad(a));
+    K.m    = m;
+    K.fn   = fn;
+
+    traverse_cone(H, &K, 0, 0, 0);
+}
+
+// Compute the unit direction d toward right ascension r and declination e,
+// in degrees, in the frame of the catalog.
+
+void hippo_sky_dir(float *d, double r, double e)
+{
+    d[0] = (float) (sin(rad(r)) * cos(rad(e)));
+    d[1] = (float) (              sin(rad(e)));
+    d[2] = (float) (cos(rad(r)) * cos(rad(e)));
+}
+
+// Zone query parameters: the set of c planes at v, the range z of V magnitude,
+// B magnitude, and B-V color, given as is a zone, and either the call-back or
+// the list to receive the stars, with any failure to extend the list.
+
+struct zoneq
+{
+    const float  *v;
+    int           c;
+    const float  *z;
+    hippo_seek_fn fn;
+    hippo_list   *L;
+    int           stat;
+};
+
+typedef struct zoneq zoneq;
+
+// Test zone q against range z. Return -1 if they are disjoint, +1 if z
+// contains q, or 0 if they overlap.
+
+static int zone_test(const float *q, const float *z)
+{
+    if (q[0] > z[3] || q[1] > z[4] || q[2] > z[5] ||
+        q[3] < z[0] || q[4] < z[1] || q[5] < z[2])
+        return -1;
+
+    if (q[0] >= z[0] && q[1] >= z[1] && q[2] >= z[2] &&
+        q[3] <= z[3] && q[4] <= z[4] && q[5] <= z[5])
+        return +1;
+
+    return 0;
+}
+
+// Return nonzero if star s lies within range z.
+
+static int zone_star(const star *s, const float *z)
+{
+    const float v = s->mag[1];
+    const float b = s->mag[0];
+
+    return v >= z[0] && b >= z[1] && b - v >= z[2]
+        && v <= z[3] && b <= z[4] && b - v <= z[5];
+}
+
+static void zone_emit(const hippo *H, zoneq *Q, uint32_t i, uint32_t c)
+{
+    if (Q->L)
+    {
+        if (Q->stat && list_stars(H, Q->L, i, c) == 0)
+            Q->stat = 0;
+    }
+    else
+        Q->fn(H->stars + i, c);
+}
+
+// Traverse the node hierarchy as does traverse, pruning nodes whose zones lie
+// outside the range. Planes and range, once found to contain a node, are not
+// tested against its children. Stars of leaves straddling the range are each
+// tested, and only runs of stars within it are given.
+
+static void traverse_zone(const hippo *H, zoneq *Q,
+                          uint32_t n, uint32_t d, int r, int t)
+{
+    const node *N = H->nodes + n;
+
+    if (r == 0)
+        r = bound_test(N->bound, Q->v, Q->c);
+
+    if (t == 0 && H->zones)
+        t = zone_test(H->zones + n * 6, Q->z);
+
+    if (r >= 0 && t >= 0 && N->starc)
+    {
+        const int l = (N->nodeL == 0 || N->nodeR == 0);
+
+        if (H->pages && d == H->pages->k)
+            page_touch(H, n);
+
+        if (t > 0 && (l || (r > 0 && whole(H))))
+        {
+            if (H->pages && d < H->pages->k)
+                page_range(H, n, d);
+
+            zone_emit(H, Q, N->star0, N->starc);
+        }
+        else if (l)
+        {
+            uint32_t s0 = N->star0;
+            uint32_t s1 = N->star0 + N->starc;
+            uint32_t s, i = s0;
+
+            for (s = s0; s < s1; s++)
+                if (!zone_star(H->stars + s, Q->z))
+                {
+                    if (i < s) zone_emit(H, Q, i, s - i);
+                    i = s + 1;
+                }
+
+            if (i < s) zone_emit(H, Q, i, s - i);
+        }
+        else
+        {
+            traverse_zone(H, Q, N->nodeL, d + 1, r, t);
+            traverse_zone(H, Q, N->nodeR, d + 1, r, t);
+        }
+    }
+}
+
+// Call fn with each list of stars that falls within the set of c planes at v,
+// as does hippo_seek, and also within the range z of magnitude and color, if
+// given. Give z as is a zone: the minimum V magnitude, B magnitude, and B-V
+// color, followed by their maxima.
+
+void hippo_seek_zone(const hippo *H, const float *v, int c, const float *z,
+                     hippo_seek_fn fn)
+{
+    zoneq Q = { v, c, z, fn, NULL, 1 };
+
+    if (z == NULL)
+        hippo_seek(H, v, c, fn);
+    else
+        traverse_zone(H, &Q, 0, 0, 0, 0);
+}
+
+// Gather the ranges of stars that fall within the set of c planes at v and
+// the range z into list L, replacing its previous contents. Return 0 on
+// failure to extend the list, leaving it empty, as does hippo_seek_list.
+
+int hippo_seek_list_zone(const hippo *H, const float *v, int c, const float *z,
+                         hippo_list *L)
+{
+    zoneq Q = { v, c, z, NULL, L, 1 };
+
+    L->c = 0;
+
+    if (z == NULL)
+        return hippo_seek_list(H, v, c, L);
+
+    traverse_zone(H, &Q, 0, 0, 0, 0);
+
+    if (Q.stat == 0)
+        L->c = 0;
+
+    return Q.stat;
+}
+
+// Ray query parameters for a packet of up to RAYS rays sharing a length,
+// radius, and hit limit: origins, directions and their reciprocals, and the
+// per-ray hit lists with their distances and counts.
+
+#define RAYS 8
+
+struct rays
+{
+    float     px[RAYS], py[RAYS], pz[RAYS];
+    float     dx[RAYS], dy[RAYS], dz[RAYS];
+    float     ix[RAYS], iy[RAYS], iz[RAYS];
+    float     t;
+    float     r;
+    uint32_t  n;
+    uint32_t *hit[RAYS];
+    float    *u  [RAYS];
+    uint32_t  c  [RAYS];
+};
+
+typedef struct rays rays;
+
+// Slab-test box b, expanded by the radius, against each ray of packet R given
+// in mask m. Return the mask of rays that enter it and are not yet satisfied
+// by nearer hits, and note the nearest entry distance among them.
+
+static unsigned ray_test(const float *b, const rays *R, unsigned m, float *e)
+{
+    float t0[RAYS];
+    float t1[RAYS];
+    unsigned k = 0;
+
+    // Compute all entry and exit distances, unconditionally, lane-wise.
+
+    for (int i = 0; i < RAYS; i++)
+    {
+        float ax = (b[0] - R->r - R->px[i]) * R->ix[i];
+        float bx = (b[3] + R->r - R->px[i]) * R->ix[i];
+        float ay = (b[1] - R->r - R->py[i]) * R->iy[i];
+        float by = (b[4] + R->r - R->py[i]) * R->iy[i];
+        float az = (b[2] - R->r - R->pz[i]) * R->iz[i];
+        float bz = (b[5] + R->r - R->pz[i]) * R->iz[i];
+
+        t0[i] = max(max(max(min(ax, bx), min(ay, by)), min(az, bz)), 0.0f);
+        t1[i] = min(min(min(max(ax, bx), max(ay, by)), max(az, bz)), R->t);
+    }
+
+    // Select the active rays that enter and might yet find a nearer hit.
+
+    *e = HUGE_VALF;
+
+    for (int i = 0; i < RAYS; i++)
+        if ((m & (1u << i)) && t0[i] <= t1[i])
+            if (R->c[i] < R->n || t0[i] < R->u[i][R->n - 1])
+            {
+                *e = min(*e, t0[i]);
+                k |= (1u << i);
+            }
+
+    return k;
+}
+
+// Insert star s at distance u into the sorted hit list of ray i of packet R,
+// dropping the farthest hit if the list is full.
+
+static void ray_hit(rays *R, int i, uint32_t s, float u)
+{
+    uint32_t j;
+
+    if      (R->c[i] < R->n)          j = R->c[i]++;
+    else if (R->u[i][R->n - 1] > u)   j = R->n - 1;
+    else return;
+
+    for (; j > 0 && R->u[i][j - 1] > u; j--)
+    {
+        R->hit[i][j] = R->hit[i][j - 1];
+        R->u  [i][j] = R->u  [i][j - 1];
+    }
+    R->hit[i][j] = s;
+    R->u  [i][j] = u;
+}
+
+// Traverse the node hierarchy front-to-back along the rays of packet R in
+// mask m, entering node n at depth d. Test stars against the capsule of each
+// ray at leaves, and visit the nearer child first elsewhere.
+
+static void traverse_ray(const hippo *H, rays *R,
+                         unsigned m, uint32_t n, uint32_t d)
+{
+    const node *N = H->nodes + n;
+
+    if (H->pages && d == H->pages->k)
+        page_touch(H, n);
+
+    if (N->nodeL == 0 || N->nodeR == 0)
+    {
+        star  u;
+        float o[3];
+
+        node_offset(H->cents, n, o);
+
+        for (uint32_t s = N->star0; s < N->star0 + N->starc; s++)
+        {
+            const float *p = star_at(&u, H->stars + s, o)->pos;
+
+            for (int i = 0; i < RAYS; i++)
+                if (m & (1u << i))
+                {
+                    float wx = p[0] - R->px[i];
+                    float wy = p[1] - R->py[i];
+                    float wz = p[2] - R->pz[i];
+                    float u  = wx * R->dx[i] + wy * R->dy[i] + wz * R->dz[i];
+
+                    u  = max(0.0f, min(R->t, u));
+                    wx = wx - R->dx[i] * u;
+                    wy = wy - R->dy[i] * u;
+                    wz = wz - R->dz[i] * u;
+
+                    if (wx * wx + wy * wy + wz * wz <= R->r * R->r)
+                        ray_hit(R, i, s, u);
+                }
+        }
+    }
+    else
+    {
+        float eL, eR;
+        unsigned mL = ray_test(H->nodes[N->nodeL].bound, R, m, &eL);
+        unsigned mR = ray_test(H->nodes[N->nodeR].bound, R, m, &eR);
+
+        // Hits found in the nearer child may prune the farther.
+
+        if (eL <= eR)
+        {
+            if (mL) traverse_ray(H, R, mL, N->nodeL, d + 1);
+            if (mR) mR = ray_test(H->nodes[N->nodeR].bound, R, mR, &eR);
+            if (mR) traverse_ray(H, R, mR, N->nodeR, d + 1);
+        }
+        else
+        {
+            if (mR) traverse_ray(H, R, mR, N->nodeR, d + 1);
+            if (mL) mL = ray_test(H->nodes[N->nodeL].bound, R, mL, &eL);
+            if (mL) traverse_ray(H, R, mL, N->nodeL, d + 1);
+        }
+    }
+}
+
+// Find the stars within distance r of each of k segments, each beginning at
+// a point of p and extending a distance t along a unit direction of d. Store
+// the indices of the nearest n stars along segment i in hits, beginning at
+// i * n, in order of distance, and their count in c[i]. Rays are traversed
+// in packets. Return 0 on failure.
+
+int hippo_seek_rays(const hippo *H, const float *p, const float *d, uint32_t k,
+                    float t, float r, uint32_t n, uint32_t *hits, uint32_t *c)
+{
+    rays  R;
+    float *u;
+
+    if (n == 0)
+    {
+        memset(c, 0, k * sizeof (uint32_t));
+        return 1;
+    }
+    if ((u = (float *) malloc(RAYS * n * sizeof (float))) == NULL)
+        return 0;
+
+    R.t = t;
+    R.r = r;
+    R.n = n;
+
+    for (uint32_t j = 0; j < k; j += RAYS)
+    {
+        unsigned m = 0;
+        float    e;
+
+        // Load a packet, padding it with copies of its first ray.
+
+        for (uint32_t i = 0; i < RAYS; i++)
+        {
+            uint32_t l = (j + i < k) ? j + i : j;
+
+            R.px[i] = p[l * 3 + 0];
+            R.py[i] = p[l * 3 + 1];
+            R.pz[i] = p[l * 3 + 2];
+            R.dx[i] = d[l * 3 + 0];
+            R.dy[i] = d[l * 3 + 1];
+            R.dz[i] = d[l * 3 + 2];
+
+            // Nudge zero components to keep the slab test free of NaN.
+
+            R.ix[i] = 1.0f / (R.dx[i] ? R.dx[i] : 1e-30f);
+            R.iy[i] = 1.0f / (R.dy[i] ? R.dy[i] : 1e-30f);
+            R.iz[i] = 1.0f / (R.dz[i] ? R.dz[i] : 1e-30f);
+
+            R.hit[i] = hits + l * n;
+            R.u  [i] = u    + i * n;
+            R.c  [i] = 0;
+
+            if (j + i < k)
+                m |= (1u << i);
+        }
+
+        if ((m = ray_test(H->nodes[0].bound, &R, m, &e)))
+            traverse_ray(H, &R, m, 0, 0);
+
+        for (uint32_t i = 0; i < RAYS && j + i < k; i++)
+            c[j + i] = R.c[i];
+    }
+    free(u);
+    return 1;
+}
+
+// Find the stars within distance r of the segment beginning at p and
+// extending a distance t along unit direction d. Store the indices of the
+// nearest n in hits, in order of distance along the segment, and return
+// their count.
+
+uint32_t hippo_seek_ray(const hippo *H, const float *p, const float *d,
+                        float t, float r, uint32_t n, uint32_t *hits)
+{
+    uint32_t c = 0;
+
+    hippo_seek_rays(H, p, d, 1, t, r, n, hits, &c);
+    return c;
+}
+
+// Return a pointer to the array of stars.
+
+const star *hippo_data(const hippo *H)
+{
+    return H->stars;
+}
+
+// Return the number of stars in the catalog, or selected by a view.
 
 uint32_t hippo_size(const hippo *H)
 {
-    return H->starc;
+    return H->starc;
+}
+
+// Return a pointer to the array of nodes.
+
+const hippo_node *hippo_node_data(const hippo *H)
+{
+    return H->nodes;
+}
+
+// Return the number of nodes in the catalog.
+
+uint32_t hippo_node_size(const hippo *H)
+{
+    return H->nodec;
+}
+
+// Return nonzero if the star positions of the catalog are relative to the
+// centers of their leaves.
+
+int hippo_rebased(const hippo *H)
+{
+    return H->cents != NULL;
+}
+
+// Return in p the center of node n, relative to which the positions of its
+// stars are given: the center of a leaf of a rebased catalog, or else zero.
+
+void hippo_node_center(const hippo *H, uint32_t n, double *p)
+{
+    node_center(H->cents, n, p);
+}
+
+// Return the leaf holding star i. The ranges of the children of each node
+// follow one another in order, so descend toward the one that includes i.
+
+uint32_t hippo_star_node(const hippo *H, uint32_t i)
+{
+    const node *N = H->nodes;
+    uint32_t    n = 0;
+
+    while (N[n].nodeL && N[n].nodeR)
+        n = (i < N[N[n].nodeR].star0) ? N[n].nodeL : N[n].nodeR;
+
+    return n;
+}
+
+// Return the catalog whose stars a view shares, or NULL if not a view.
+
+const hippo *hippo_parent(const hippo *H)
+{
+    return H->parent;
+}
+
+//-----------------------------------------------------------------------------
+
+// A cache job copies c stars from the catalog at src to the buffer at dst.
+
+struct job
+{
+    const star *src;
+    star       *dst;
+    uint32_t    c;
+};
+
+typedef struct job job;
+
+// The cache structure manages a ring buffer of n stars holding copies of the
+// node ranges of a catalog. Each node records its offset within the ring, or
+// NONE, and the frame in which it was last drawn. Resident nodes are queued
+// in order of allocation. A worker thread performs the copies.
+
+struct hippo_cache
+{
+    const hippo    *H;
+    star           *dst;
+
+    uint32_t        n;
+    uint32_t        head;
+    uint32_t        frame;
+
+    uint32_t       *slot;
+    uint32_t       *stamp;
+    uint32_t       *queue;
+    uint32_t        queue0;
+    uint32_t        queuec;
+
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  ready;
+    pthread_cond_t  done;
+
+    job            *jobs;
+    uint32_t        jobi;
+    uint32_t        jobc;
+    uint32_t        jobd;
+    uint32_t        jobn;
+    int             quit;
+};
+
+// Perform queued copies until told to quit.
+
+static void *cache_work(void *data)
+{
+    hippo_cache *C = (hippo_cache *) data;
+
+    pthread_mutex_lock(&C->mutex);
+
+    while (!C->quit)
+    {
+        if (C->jobi < C->jobc)
+        {
+            job j = C->jobs[C->jobi++];
+
+            pthread_mutex_unlock(&C->mutex);
+            memcpy(j.dst, j.src, j.c * sizeof (star));
+            pthread_mutex_lock(&C->mutex);
+
+            if (++C->jobd == C->jobc)
+                pthread_cond_signal(&C->done);
+        }
+        else pthread_cond_wait(&C->ready, &C->mutex);
+    }
+    pthread_mutex_unlock(&C->mutex);
+    return NULL;
+}
+
+// Queue a copy of c stars from src to dst.
+
+static int cache_copy(hippo_cache *C, const star *src, star *dst, uint32_t c)
+{
+    int stat = 0;
+
+    pthread_mutex_lock(&C->mutex);
+
+    if (C->jobc == C->jobn)
+    {
+        uint32_t n = C->jobn ? C->jobn * 2 : 256;
+        job     *j;
+
+        if ((j = (job *) realloc(C->jobs, n * sizeof (job))))
+        {
+            C->jobs = j;
+            C->jobn = n;
+        }
+    }
+    if (C->jobc < C->jobn)
+    {
+        C->jobs[C->jobc].src = src;
+        C->jobs[C->jobc].dst = dst;
+        C->jobs[C->jobc].c   = c;
+        C->jobc++;
+        stat = 1;
+
+        pthread_cond_signal(&C->ready);
+    }
+    pthread_mutex_unlock(&C->mutex);
+    return stat;
+}
+
+// Release the oldest resident node.
+
+static void cache_evict(hippo_cache *C)
+{
+    C->slot[C->queue[C->queue0]] = NONE;
+    C->queue0 = (C->queue0 + 1) % C->H->nodec;
+    C->queuec--;
+}
+
+// Allocate c stars at the head of the ring on behalf of node k, evicting the
+// oldest nodes as necessary. Fail rather than evict a node already drawn in
+// the current frame.
+
+static uint32_t cache_alloc(hippo_cache *C, uint32_t k, uint32_t c)
+{
+    uint32_t s;
+
+    if (c > C->n)
+        return NONE;
+
+    // If the range would pass the end of the ring, wrap to the beginning.
+
+    if (C->head + c > C->n)
+    {
+        while (C->queuec && C->slot[s = C->queue[C->queue0]] >= C->head)
+            if (C->stamp[s] == C->frame)
+                return NONE;
+            else
+                cache_evict(C);
+
+        C->head = 0;
+    }
+
+    // Evict all nodes overlapping the new range.
+
+    while (C->queuec && C->slot[s = C->queue[C->queue0]] >= C->head
+                     && C->slot[s] < C->head + c)
+        if (C->stamp[s] == C->frame)
+            return NONE;
+        else
+            cache_evict(C);
+
+    C->queue[(C->queue0 + C->queuec) % C->H->nodec] = k;
+    C->queuec++;
+
+    C->slot[k] = C->head;
+    C->head   += c;
+
+    return C->slot[k];
+}
+
+// A cache query gathers the ranges of cache C into list L, noting any failure
+// to append.
+
+struct cacheq
+{
+    hippo_cache *C;
+    hippo_list  *L;
+    int          stat;
+};
+
+typedef struct cacheq cacheq;
+
+// Ensure that the stars of one visible node are resident and list them.
+
+static void visit_cache(const hippo *H, const node *N, void *data)
+{
+    cacheq      *Q = (cacheq *) data;
+    hippo_cache *C = Q->C;
+
+    uint32_t k = (uint32_t) (N - H->nodes);
+
+    if (N->starc == 0 || Q->stat == 0)
+        return;
+
+    if (C->slot[k] == NONE)
+    {
+        if (cache_alloc(C, k, N->starc) == NONE)
+            return;
+
+        if (cache_copy(C, H->stars + N->star0, C->dst + C->slot[k], N->starc) == 0)
+        {
+            C->slot[k] = NONE;
+            return;
+        }
+    }
+    C->stamp[k] = C->frame;
+
+    if (hippo_list_append(Q->L, C->slot[k], N->starc) == 0)
+        Q->stat = 0;
+}
+
+// Create a cache able to hold n stars of catalog H. The ranges of a cache lie
+// within its ring, which would lose the leaves of a rebased catalog, so refuse
+// one.
+
+hippo_cache *hippo_cache_create(const hippo *H, uint32_t n)
+{
+    hippo_cache *C;
+
+    if (H->cents == NULL && (C = (hippo_cache *) calloc(sizeof (hippo_cache), 1)))
+    {
+        C->H     = H;
+        C->n     = n;
+        C->frame = 1;
+
+        C->slot  = (uint32_t *) malloc(H->nodec * sizeof (uint32_t));
+        C->stamp = (uint32_t *) calloc(H->nodec,  sizeof (uint32_t));
+        C->queue = (uint32_t *) malloc(H->nodec * sizeof (uint32_t));
+
+        if (C->slot && C->stamp && C->queue)
+        {
+            memset(C->slot, 0xFF, H->nodec * sizeof (uint32_t));
+
+            pthread_mutex_init(&C->mutex, NULL);
+            pthread_cond_init (&C->ready, NULL);
+            pthread_cond_init (&C->done,  NULL);
+
+            if (pthread_create(&C->thread, NULL, cache_work, C) == 0)
+                return C;
+
+            pthread_cond_destroy (&C->done);
+            pthread_cond_destroy (&C->ready);
+            pthread_mutex_destroy(&C->mutex);
+        }
+        free(C->queue);
+        free(C->stamp);
+        free(C->slot);
+        free(C);
+    }
+    return NULL;
+}
+
+// Stop the worker and release all cache storage.
+
+void hippo_cache_free(hippo_cache *C)
+{
+    if (C)
+    {
+        pthread_mutex_lock(&C->mutex);
+        C->quit = 1;
+        pthread_cond_signal(&C->ready);
+        pthread_mutex_unlock(&C->mutex);
+
+        pthread_join(C->thread, NULL);
+
+        pthread_cond_destroy (&C->done);
+        pthread_cond_destroy (&C->ready);
+        pthread_mutex_destroy(&C->mutex);
+
+        free(C->jobs);
+        free(C->queue);
+        free(C->stamp);
+        free(C->slot);
+        free(C);
+    }
+}
+
+// Begin a frame, copying newly-visible stars into the n-star buffer at dst.
+// This is usually a mapping of a GPU vertex buffer.
+
+void hippo_cache_begin(hippo_cache *C, star *dst)
+{
+    C->dst = dst;
+    C->frame++;
+}
+
+// Find the nodes falling within the set of c planes at v, queue copies of any
+// that are not yet resident, and gather their ranges within the buffer into
+// list L. Nodes that cannot be made resident without evicting another node
+// of the same frame are omitted. Return 0 on failure, leaving L empty.
+
+int hippo_cache_seek(hippo_cache *C, const float *v, int c, hippo_list *L)
+{
+    cacheq Q = { C, L, 1 };
+
+    L->c = 0;
+    traverse(C->H, v, c, visit_cache, &Q, 0, 0);
+
+    if (Q.stat == 0)
+        L->c = 0;
+
+    return Q.stat;
+}
+
+// Wait for all queued copies of the current frame to complete.
+
+void hippo_cache_end(hippo_cache *C)
+{
+    pthread_mutex_lock(&C->mutex);
+
+    while (C->jobd < C->jobc)
+        pthread_cond_wait(&C->done, &C->mutex);
+
+    C->jobi = 0;
+    C->jobc = 0;
+    C->jobd = 0;
+
+    pthread_mutex_unlock(&C->mutex);
+}
+
+// Forget all resident nodes, as when the contents of the buffer are lost.
+// No copies may be pending.
+
+void hippo_cache_reset(hippo_cache *C)
+{
+    memset(C->slot, 0xFF, C->H->nodec * sizeof (uint32_t));
+
+    C->head   = 0;
+    C->queue0 = 0;
+    C->queuec = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+// The cut structure records the terminal nodes of the most recent traversal:
+// those found to be outside, those found to be inside, and the leaves found
+// to straddle the bounding planes. Together these cover every star exactly
+// once. The state of each node gives its classification, or zero if the node
+// is not in the cut.
+
+enum { CUT_NONE, CUT_OUT, CUT_IN, CUT_LEAF, CUT_SPLIT };
+
+struct hippo_cut
+{
+    const hippo *H;
+    uint32_t    *parent;
+    uint8_t     *state;
+    uint32_t    *cut;
+    uint32_t     cutc;
+    uint32_t    *tmp;
+    uint32_t     tmpc;
+    uint64_t    *keys;
+};
+
+#define drawn(s) ((s) == CUT_IN || (s) == CUT_LEAF)
+
+// Classify node n with respect to the set of c planes at v.
+
+static int cut_test(const hippo *H, uint32_t n, const float *v, int c)
+{
+    int r = bound_test(H->nodes[n].bound, v, c);
+
+    if (r < 0) return CUT_OUT;
+    if (r > 0 && whole(H)) return CUT_IN;
+
+    if (H->nodes[n].nodeL == 0 || H->nodes[n].nodeR == 0)
+        return CUT_LEAF;
+    else
+        return CUT_SPLIT;
+}
+
+// Note the addition or removal of node n to or from the drawn set.
+
+static void cut_note(const hippo *H, hippo_list *L, uint32_t n)
+{
+    if (L) list_stars(H, L, H->nodes[n].star0, H->nodes[n].starc);
+}
+
+// Add node n, of newly-determined state s, to the new cut. Descend through it
+// if it is split.
+
+static void cut_push(hippo_cut *C, const float *v, int c,
+                     hippo_list *add, uint32_t n, int s)
+{
+    const hippo *H = C->H;
+
+    if (s == CUT_SPLIT)
+    {
+        uint32_t l = H->nodes[n].nodeL;
+        uint32_t r = H->nodes[n].nodeR;
+
+        cut_push(C, v, c, add, l, cut_test(H, l, v, c));
+        cut_push(C, v, c, add, r, cut_test(H, r, v, c));
+    }
+    else
+    {
+        if (drawn(s))
+        {
+            if (H->pages)
+                page_node(H, n);
+
+            cut_note(H, add, n);
+        }
+
+        C->state[n] = (uint8_t) s;
+        C->tmp[C->tmpc++] = n;
+    }
+}
+
+// Replace node n and its sibling with their parent, recursively, as long as
+// both have the same uniform state and the parent shares it.
+
+static void cut_merge(hippo_cut *C, const float *v, int c,
+                      hippo_list *add, hippo_list *sub, uint32_t n)
+{
+    const hippo *H = C->H;
+    uint32_t     p;
+
+    while ((p = C->parent[n]) != NONE)
+    {
+        uint32_t l = H->nodes[p].nodeL;
+        uint32_t r = H->nodes[p].nodeR;
+        int      s = C->state[n];
+
+        if ((s == CUT_IN || s == CUT_OUT) && C->state[l] == s
+                                          && C->state[r] == s
+                                          && cut_test(H, p, v, c) == s)
+        {
+            if (s == CUT_IN)
+            {
+                cut_note(H, sub, l);
+                cut_note(H, sub, r);
+                cut_note(H, add, p);
+            }
+            C->state[l] = CUT_NONE;
+            C->state[r] = CUT_NONE;
+            C->state[p] = (uint8_t) s;
+            C->tmp[C->tmpc++] = p;
+            n = p;
+        }
+        else break;
+    }
+}
+
+// Create a coherent visibility tracker for catalog H.
+
+hippo_cut *hippo_cut_create(const hippo *H)
+{
+    hippo_cut *C;
+
+    if ((C = (hippo_cut *) calloc(sizeof (hippo_cut), 1)))
+    {
+        C->H      = H;
+        C->parent = (uint32_t *) malloc(H->nodec * sizeof (uint32_t));
+        C->state  = (uint8_t  *) calloc(H->nodec,  sizeof (uint8_t));
+        C->cut    = (uint32_t *) malloc(H->nodec * sizeof (uint32_t));
+        C->tmp    = (uint32_t *) malloc(H->nodec * sizeof (uint32_t) * 2);
+        C->keys   = (uint64_t *) malloc(H->nodec * sizeof (uint64_t));
+
+        if (C->parent && C->state && C->cut && C->tmp && C->keys && H->nodec)
+        {
+            C->parent[0] = NONE;
+
+            for (uint32_t n = 0; n < H->nodec; n++)
+                if (H->nodes[n].nodeL && H->nodes[n].nodeR)
+                {
+                    C->parent[H->nodes[n].nodeL] = n;
+                    C->parent[H->nodes[n].nodeR] = n;
+                }
+
+            // Begin with the root, classified as outside.
+
+            C->state[0] = CUT_OUT;
+            C->cut[0]   = 0;
+            C->cutc     = 1;
+
+            return C;
+        }
+        hippo_cut_free(C);
+    }
+    return NULL;
+}
+
+// Release a coherent visibility tracker.
+
+void hippo_cut_free(hippo_cut *C)
+{
+    if (C)
+    {
+        free(C->keys);
+        free(C->tmp);
+        free(C->cut);
+        free(C->state);
+        free(C->parent);
+        free(C);
+    }
+}
+
+// Update the visible set to the set of c planes at v. Re-test only the nodes
+// of the previous cut, refining those that now straddle the planes and
+// coarsening those whose siblings now agree. Append the ranges leaving the
+// visible set to sub and the ranges entering it to add, either of which may
+// be NULL. Removals are to be applied before additions.
+
+void hippo_cut_update(hippo_cut *C, const float *v, int c,
+                      hippo_list *add, hippo_list *sub)
+{
+    const hippo *H = C->H;
+
+    if (add) add->c = 0;
+    if (sub) sub->c = 0;
+
+    // Refine the previous cut.
+
+    C->tmpc = 0;
+
+    for (uint32_t i = 0; i < C->cutc; i++)
+    {
+        uint32_t n = C->cut[i];
+        int      o = C->state[n];
+        int      s = cut_test(H, n, v, c);
+
+        if (drawn(o) && !drawn(s))
+            cut_note(H, sub, n);
+
+        C->state[n] = CUT_NONE;
+
+        if (drawn(o) && drawn(s))
+        {
+            C->state[n] = (uint8_t) s;
+            C->tmp[C->tmpc++] = n;
+        }
+        else cut_push(C, v, c, add, n, s);
+    }
+
+    // Coarsen it, and retain only those nodes still in it.
+
+    for (uint32_t i = 0, m = C->tmpc; i < m; i++)
+        if (C->state[C->tmp[i]])
+            cut_merge(C, v, c, add, sub, C->tmp[i]);
+
+    C->cutc = 0;
+
+    for (uint32_t i = 0; i < C->tmpc; i++)
+        if (C->state[C->tmp[i]])
+            C->cut[C->cutc++] = C->tmp[i];
+}
+
+static int cut_cmp(const void *a, const void *b)
+{
+    return (*(const uint64_t *) a < *(const uint64_t *) b) ? -1 :
+           (*(const uint64_t *) a > *(const uint64_t *) b) ? +1 : 0;
+}
+
+// Gather the ranges of all currently visible stars into list L, in order.
+
+void hippo_cut_list(hippo_cut *C, hippo_list *L)
+{
+    const hippo *H = C->H;
+    uint32_t     k = 0;
+
+    // Sort the visible nodes by their first star.
+
+    for (uint32_t i = 0; i < C->cutc; i++)
+        if (drawn(C->state[C->cut[i]]))
+            C->keys[k++] = (uint64_t) H->nodes[C->cut[i]].star0 << 32 | C->cut[i];
+
+    qsort(C->keys, k, sizeof (uint64_t), cut_cmp);
+
+    L->c = 0;
+
+    for (uint32_t i = 0; i < k; i++)
+    {
+        uint32_t n = (uint32_t) (C->keys[i] & 0xFFFFFFFF);
+        list_stars(H, L, H->nodes[n].star0, H->nodes[n].starc);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// The async structure runs the queries of a catalog on a worker thread, one
+// frame ahead of their use. The front list is held by the caller while the
+// back list receives the query in flight. Each query is made with its planes
+// pushed outward by distance e, so that a viewer moving less than e between
+// frames finds no visible star missing from a list one frame old.
+
+#define ASYNC_PLANES 32
+
+struct hippo_async
+{
+    const hippo    *H;
+    float           e;
+
+    hippo_list      list[2];
+    int             front;
+
+    float           v[ASYNC_PLANES * 4];
+    int             c;
+
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  ready;
+    pthread_cond_t  done;
+
+    int             busy;
+    int             valid;
+    int             quit;
+};
+
+// Perform each requested query into the back list until told to quit. The
+// planes and buffers are not touched by the caller while a query is busy.
+
+static void *async_work(void *data)
+{
+    hippo_async *A = (hippo_async *) data;
+
+    pthread_mutex_lock(&A->mutex);
+
+    while (!A->quit)
+    {
+        if (A->busy)
+        {
+            pthread_mutex_unlock(&A->mutex);
+            hippo_seek_list(A->H, A->v, A->c, A->list + 1 - A->front);
+            pthread_mutex_lock(&A->mutex);
+
+            A->busy = 0;
+            pthread_cond_signal(&A->done);
+        }
+        else pthread_cond_wait(&A->ready, &A->mutex);
+    }
+    pthread_mutex_unlock(&A->mutex);
+    return NULL;
+}
+
+// Copy the c planes at v, pushing each outward by the expansion distance.
+
+static void async_planes(hippo_async *A, const float *v, int c)
+{
+    int i;
+
+    for (i = 0; i < c * 4; i++)
+        A->v[i] = v[i];
+    for (i = 0; i < c; i++)
+        A->v[i * 4 + 3] += A->e;
+
+    A->c = c;
+}
+
+// Create an asynchronous query of catalog H with plane expansion distance e.
+
+hippo_async *hippo_async_create(const hippo *H, float e)
+{
+    hippo_async *A;
+
+    if ((A = (hippo_async *) calloc(sizeof (hippo_async), 1)))
+    {
+        A->H = H;
+        A->e = e;
+
+        pthread_mutex_init(&A->mutex, NULL);
+        pthread_cond_init (&A->ready, NULL);
+        pthread_cond_init (&A->done,  NULL);
+
+        if (pthread_create(&A->thread, NULL, async_work, A) == 0)
+            return A;
+
+        pthread_cond_destroy (&A->done);
+        pthread_cond_destroy (&A->ready);
+        pthread_mutex_destroy(&A->mutex);
+        free(A);
+    }
+    return NULL;
+}
+
+// Stop the worker, abandoning any query in flight, and release both lists.
+
+void hippo_async_free(hippo_async *A)
+{
+    if (A)
+    {
+        pthread_mutex_lock(&A->mutex);
+        A->quit = 1;
+        pthread_cond_signal(&A->ready);
+        pthread_mutex_unlock(&A->mutex);
+
+        pthread_join(A->thread, NULL);
+
+        pthread_cond_destroy (&A->done);
+        pthread_cond_destroy (&A->ready);
+        pthread_mutex_destroy(&A->mutex);
+
+        hippo_list_free(A->list + 0);
+        hippo_list_free(A->list + 1);
+        free(A);
+    }
+}
+
+// Wait for the query begun by the previous call, begin a query of the set of
+// c planes at v, and return the result of the previous query. The first call
+// queries synchronously. The list remains valid until the next call.
+
+const hippo_list *hippo_async_seek(hippo_async *A, const float *v, int c)
+{
+    if (c < 0 || c > ASYNC_PLANES)
+        return NULL;
+
+    pthread_mutex_lock(&A->mutex);
+
+    while (A->busy)
+        pthread_cond_wait(&A->done, &A->mutex);
+
+    if (A->valid == 0)
+    {
+        async_planes(A, v, c);
+        hippo_seek_list(A->H, A->v, A->c, A->list + 1 - A->front);
+        A->valid = 1;
+    }
+    A->front = 1 - A->front;
+
+    async_planes(A, v, c);
+    A->busy = 1;
+    pthread_cond_signal(&A->ready);
+
+    pthread_mutex_unlock(&A->mutex);
+
+    return A->list + A->front;
+}
+
+//-----------------------------------------------------------------------------
+
+// The handle structure publishes a current catalog to any number of readers,
+// allowing it to be replaced while queries of the old one are in flight. Each
+// reader counts itself into the reader count of the parity of the epoch at
+// which it arrived. A swap publishes the new catalog, advances the epoch, and
+// waits for the count of the old parity to drain before releasing the old
+// catalog. Readers take no lock. Swaps are serialized by a mutex.
+
+struct hippo_handle
+{
+    hippo          *H;
+    uint32_t        epoch;
+    uint32_t        count[2];
+    pthread_mutex_t mutex;
+};
+
+// Create a handle publishing catalog H, which it takes ownership of.
+
+hippo_handle *hippo_handle_create(hippo *H)
+{
+    hippo_handle *R;
+
+    if ((R = (hippo_handle *) calloc(sizeof (hippo_handle), 1)))
+    {
+        pthread_mutex_init(&R->mutex, NULL);
+        R->H = H;
+    }
+    return R;
+}
+
+// Take a read reference to the current catalog of R, storing in k the parity
+// to be given to the matching release. The epoch is checked again after the
+// count is raised, so that a swap waiting on the other parity cannot miss it.
+
+const hippo *hippo_handle_acquire(hippo_handle *R, int *k)
+{
+    uint32_t e;
+
+    for (;;)
+    {
+        e = __atomic_load_n(&R->epoch, __ATOMIC_SEQ_CST);
+
+        __atomic_fetch_add(R->count + (e & 1), 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&R->epoch, __ATOMIC_SEQ_CST) == e)
+            break;
+
+        __atomic_fetch_sub(R->count + (e & 1), 1, __ATOMIC_RELEASE);
+    }
+
+    *k = (int) (e & 1);
+
+    return __atomic_load_n(&R->H, __ATOMIC_SEQ_CST);
+}
+
+// Release a read reference taken with parity k.
+
+void hippo_handle_release(hippo_handle *R, int k)
+{
+    __atomic_fetch_sub(R->count + (k & 1), 1, __ATOMIC_RELEASE);
+}
+
+// Publish catalog H in place of the current catalog of R, taking ownership of
+// it. Wait for the readers of the old catalog to release it, and free it. The
+// drain is sequentially consistent with the count and epoch of acquire, so
+// that a reader either is seen here or sees the new epoch and retries. A
+// thread holding a read reference to R that swaps or frees R deadlocks, as
+// it waits on its own reference.
+
+void hippo_handle_swap(hippo_handle *R, hippo *H)
+{
+    hippo   *O;
+    uint32_t e;
+
+    pthread_mutex_lock(&R->mutex);
+
+    O = __atomic_exchange_n(&R->H, H, __ATOMIC_SEQ_CST);
+    e = __atomic_fetch_add(&R->epoch, 1, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(R->count + (e & 1), __ATOMIC_SEQ_CST))
+        sched_yield();
+
+    pthread_mutex_unlock(&R->mutex);
+
+    hippo_free(O);
+}
+
+// Release a handle and its current catalog, once all readers have finished.
+
+void hippo_handle_free(hippo_handle *R)
+{
+    if (R)
+    {
+        hippo_handle_swap(R, NULL);
+        pthread_mutex_destroy(&R->mutex);
+        free(R);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// A join task pairs two nodes, possibly the same node.
+
+struct task
+{
+    uint32_t a;
+    uint32_t b;
+};
+
+typedef struct task task;
+
+// The join structure holds the state shared by all threads of a self-join
+// within distance r: the tasks, the next one due, and the pair call-back,
+// which is serialized.
+
+#define PAIRS 4096
+
+struct join
+{
+    const hippo    *H;
+    float           r;
+    hippo_pair_fn   fn;
+
+    task           *tasks;
+    uint32_t        taskc;
+    uint32_t        taskn;
+    uint32_t        taski;
+    int             fail;
+
+    pthread_mutex_t mutex;
+};
+
+typedef struct join join;
+
+// Each join thread gathers pairs into a buffer before passing them along.
+
+struct pairs
+{
+    join     *J;
+    uint32_t  c;
+    uint32_t  p[PAIRS * 2];
+};
+
+typedef struct pairs pairs;
+
+// Return the square of the least distance between boxes a and b.
+
+static float box_dist(const float *a, const float *b)
+{
+    float d = 0, t;
+
+    for (int i = 0; i < 3; i++)
+        if      ((t = a[i] - b[i + 3]) > 0) d += t * t;
+        else if ((t = b[i] - a[i + 3]) > 0) d += t * t;
+
+    return d;
+}
+
+// Pass along the buffered pairs of P.
+
+static void pairs_flush(pairs *P)
+{
+    if (P->c)
+    {
+        pthread_mutex_lock(&P->J->mutex);
+        P->J->fn(P->p, P->c);
+        pthread_mutex_unlock(&P->J->mutex);
+        P->c = 0;
+    }
+}
+
+// Buffer the pair of stars i and j if they lie within the join distance,
+// where o is the offset from the frame of j to that of i.
+
+static void pairs_test(pairs *P, uint32_t i, uint32_t j, const float *o)
+{
+    const float *a = P->J->H->stars[i].pos;
+    const float *b = P->J->H->stars[j].pos;
+
+    float dx = a[0] + o[0] - b[0];
+    float dy = a[1] + o[1] - b[1];
+    float dz = a[2] + o[2] - b[2];
+
+    if (dx * dx + dy * dy + dz * dz <= P->J->r * P->J->r)
+    {
+        P->p[P->c * 2 + 0] = i;
+        P->p[P->c * 2 + 1] = j;
+
+        if (++P->c == PAIRS)
+            pairs_flush(P);
+    }
+}
+
+// Find all pairs of stars within the join distance with one star beneath node
+// a and the other beneath node b, pruning node pairs whose bounds lie farther
+// apart. If a and b are the same node, count each pair only once.
+
+static void join_node(pairs *P, uint32_t a, uint32_t b)
+{
+    const float  r = P->J->r;
+    const node  *N = P->J->H->nodes;
+    const node  *A = N + a;
+    const node  *B = N + b;
+
+    if (a != b && box_dist(A->bound, B->bound) > r * r)
+        return;
+
+    int la = (A->nodeL == 0 || A->nodeR == 0);
+    int lb = (B->nodeL == 0 || B->nodeR == 0);
+
+    if (la && lb)
+    {
+        double ca[3];
+        double cb[3];
+        float  o [3];
+
+        if (P->J->H->pages)
+        {
+            page_node(P->J->H, a);
+            page_node(P->J->H, b);
+        }
+
+        // Find the offset between the frames of rebased leaves.
+
+        node_center(P->J->H->cents, a, ca);
+        node_center(P->J->H->cents, b, cb);
+
+        o[0] = (float) (ca[0] - cb[0]);
+        o[1] = (float) (ca[1] - cb[1]);
+        o[2] = (float) (ca[2] - cb[2]);
+
+        for (uint32_t i = A->star0; i < A->star0 + A->starc; i++)
+            for (uint32_t j = (a == b) ? i + 1 : B->star0;
+                          j < B->star0 + B->starc; j++)
+                pairs_test(P, i, j, o);
+    }
+    else if (a == b)
+    {
+        join_node(P, A->nodeL, A->nodeL);
+        join_node(P, A->nodeL, A->nodeR);
+        join_node(P, A->nodeR, A->nodeR);
+    }
+    else if (lb || (!la && A->starc >= B->starc))
+    {
+        join_node(P, A->nodeL, b);
+        join_node(P, A->nodeR, b);
+    }
+    else
+    {
+        join_node(P, a, B->nodeL);
+        join_node(P, a, B->nodeR);
+    }
+}
+
+// Enumerate the node pairs to be joined as independent tasks, descending the
+// same way as join_node until both nodes of a pair lie at depth k or below.
+
+static void join_task(join *J, uint32_t a, uint32_t b, uint32_t d, uint32_t k)
+{
+    const node *A = J->H->nodes + a;
+    const node *B = J->H->nodes + b;
+
+    if (a != b && box_dist(A->bound, B->bound) > J->r * J->r)
+        return;
+
+    if (d >= k || A->nodeL == 0 || A->nodeR == 0
+               || B->nodeL == 0 || B->nodeR == 0)
+    {
+        if (J->taskc == J->taskn)
+        {
+            uint32_t n = J->taskn ? J->taskn * 2 : 256;
+            task    *t;
+
+            if ((t = (task *) realloc(J->tasks, n * sizeof (task))) == NULL)
+            {
+                J->fail = 1;
+                return;
+            }
+
+            J->tasks = t;
+            J->taskn = n;
+        }
+        J->tasks[J->taskc].a = a;
+        J->tasks[J->taskc].b = b;
+        J->taskc++;
+    }
+    else if (a == b)
+    {
+        join_task(J, A->nodeL, A->nodeL, d + 1, k);
+        join_task(J, A->nodeL, A->nodeR, d + 1, k);
+        join_task(J, A->nodeR, A->nodeR, d + 1, k);
+    }
+    else
+    {
+        join_task(J, A->nodeL, B->nodeL, d + 1, k);
+        join_task(J, A->nodeL, B->nodeR, d + 1, k);
+        join_task(J, A->nodeR, B->nodeL, d + 1, k);
+        join_task(J, A->nodeR, B->nodeR, d + 1, k);
+    }
+}
+
+// Perform join tasks until none remain.
+
+static void *join_work(void *data)
+{
+    join     *J = (join *) data;
+    pairs    *P;
+    uint32_t  i;
+
+    if ((P = (pairs *) malloc(sizeof (pairs))))
+    {
+        P->J = J;
+        P->c = 0;
+
+        for (;;)
+        {
+            pthread_mutex_lock(&J->mutex);
+            i = J->taski++;
+            pthread_mutex_unlock(&J->mutex);
+
+            if (i < J->taskc)
+                join_node(P, J->tasks[i].a, J->tasks[i].b);
+            else
+                break;
+        }
+        pairs_flush(P);
+        free(P);
+    }
+    return NULL;
+}
+
+// Call fn with buffers of all pairs of stars lying within distance r of one
+// another, using t threads. Return 0 on failure.
+
+int hippo_join(const hippo *H, float r, int t, hippo_pair_fn fn)
+{
+    pthread_t *T;
+    join       J;
+    int        stat = 0;
+    uint32_t   k    = 4;
+
+    memset(&J, 0, sizeof (join));
+
+    J.H  = H;
+    J.r  = r;
+    J.fn = fn;
+
+    // Split the work several times more finely than the thread count.
+
+    t = (t > 1) ? t : 1;
+
+    while ((1 << k) < t * 16)
+        k++;
+
+    join_task(&J, 0, 0, 0, k);
+
+    if (J.fail == 0 && (T = (pthread_t *) calloc(t, sizeof (pthread_t))))
+    {
+        int n = 0;
+
+        pthread_mutex_init(&J.mutex, NULL);
+
+        // Start the helper threads and work alongside them.
+
+        while (n < t - 1 && pthread_create(T + n, NULL, join_work, &J) == 0)
+            n++;
+
+        join_work(&J);
+
+        while (n > 0)
+            pthread_join(T[--n], NULL);
+
+        pthread_mutex_destroy(&J.mutex);
+        stat = (J.taski > J.taskc);
+        free(T);
+    }
+    free(J.tasks);
+    return stat;
+}
+
+//-----------------------------------------------------------------------------
+
+// Ensure that selection S has room for c more stars. Return 0 on failure.
+
+static int sel_grow(hippo_sel *S, uint32_t c)
+{
+    if (S->c + c > S->n)
+    {
+        uint32_t  n = S->n ? S->n : 256;
+        uint32_t *p;
+
+        while (n < S->c + c)
+            n *= 2;
+
+        if ((p = (uint32_t *) realloc(S->index, n * sizeof (uint32_t))) == NULL)
+            return 0;
+
+        S->index = p;
+        S->n     = n;
+    }
+    return 1;
+}
+
+// Append stars i through i + c to selection S. Return 0 on failure.
+
+static int sel_range(hippo_sel *S, uint32_t i, uint32_t c)
+{
+    if (sel_grow(S, c) == 0)
+        return 0;
+
+    for (uint32_t j = 0; j < c; j++)
+        S->index[S->c++] = i + j;
+
+    return 1;
+}
+
+// Release the storage of selection S, leaving it empty.
+
+void hippo_sel_free(hippo_sel *S)
+{
+    free(S->index);
+
+    S->index = NULL;
+    S->c     = 0;
+    S->n     = 0;
+}
+
+// The known results of the first 32 leaves of a predicate tree, numbered in
+// pre-order: bit j of y is set if leaf j holds for every star of a node, and
+// bit j of n if it holds for none. These hold for the subtree of the node.
+
+struct scan_known
+{
+    uint32_t y;
+    uint32_t n;
+};
+
+typedef struct scan_known scan_known;
+
+// Classify node n of catalog H under leaf predicate P: -1 if none of its stars
+// can satisfy it, +1 if all of them must, or 0 if its stars must be tested.
+// Bounds decide positional predicates. Zones decide magnitude and color
+// ranges, as do aggregates for magnitude, lacking zones.
+
+static int scan_bound(const hippo *H, const hippo_pred *P, uint32_t n)
+{
+    const node  *N = H->nodes + n;
+    const aggr  *A = H->aggrs ? H->aggrs + n     : NULL;
+    const float *Z = H->zones ? H->zones + n * 6 : NULL;
+
+    switch (P->op)
+    {
+        case HIPPO_PRED_V:
+        case HIPPO_PRED_BV:
+
+            if (Z)
+            {
+                const int i = (P->op == HIPPO_PRED_V) ? 0 : 2;
+
+                if (Z[i] > P->max || Z[i + 3] < P->min)
+                    return -1;
+                if (Z[i] >= P->min && Z[i + 3] <= P->max)
+                    return +1;
+            }
+            else if (A && P->op == HIPPO_PRED_V)
+            {
+                if (A->count == 0 || A->vmin > P->max || A->vmax < P->min)
+                    return -1;
+                if (A->vmin >= P->min && A->vmax <= P->max)
+                    return +1;
+            }
+            return 0;
+
+        case HIPPO_PRED_DIST:
+        {
+            const float *q = N->bound;
+            const float  l = max(P->min, 0);
+            float        d0 = 0;
+            float        d1 = 0;
+
+            // Find the nearest and farthest squared distances of the bound.
+
+            for (int i = 0; i < 3; i++)
+            {
+                const float u = q[i    ] - P->p[i];
+                const float v = q[i + 3] - P->p[i];
+
+                if (u > 0) d0 += u * u;
+                if (v < 0) d0 += v * v;
+
+                d1 += max(u * u, v * v);
+            }
+
+            if (d0 > P->max * P->max || d1 < l * l)
+                return -1;
+            if (d0 >= l * l && d1 <= P->max * P->max)
+                return +1;
+            return 0;
+        }
+
+        case HIPPO_PRED_PLANES:
+            return bound_test_closed(N->bound, P->v, P->c);
+    }
+    return 0;
+}
+
+// Classify node n under predicate P, as does scan_bound, given the known
+// results K of its parent, and note the leaves newly decided. Counter j gives
+// the number of the next leaf. Both operands are always classified, so that
+// leaf numbers remain consistent.
+
+static int scan_test(const hippo *H, const hippo_pred *P, uint32_t n,
+                     scan_known *K, uint32_t *j)
+{
+    int a;
+    int b;
+
+    switch (P->op)
+    {
+        case HIPPO_PRED_AND:
+            a = scan_test(H, P->a, n, K, j);
+            b = scan_test(H, P->b, n, K, j);
+            return (a < 0 || b < 0) ? -1 : (a > 0 && b > 0) ? +1 : 0;
+
+        case HIPPO_PRED_OR:
+            a = scan_test(H, P->a, n, K, j);
+            b = scan_test(H, P->b, n, K, j);
+            return (a > 0 || b > 0) ? +1 : (a < 0 && b < 0) ? -1 : 0;
+
+        case HIPPO_PRED_NOT:
+            return -scan_test(H, P->a, n, K, j);
+
+        default:
+        {
+            const uint32_t i = (*j)++;
+            const uint32_t k = (i < 32) ? (1u << i) : 0;
+
+            if (K->y & k) return +1;
+            if (K->n & k) return -1;
+
+            if ((a = scan_bound(H, P, n)) > 0) K->y |= k;
+            if ((a                      ) < 0) K->n |= k;
+
+            return a;
+        }
+    }
+}
+
+// Return the number of leaves of predicate P.
+
+static uint32_t scan_size(const hippo_pred *P)
+{
+    switch (P->op)
+    {
+        case HIPPO_PRED_AND:
+        case HIPPO_PRED_OR:  return scan_size(P->a) + scan_size(P->b);
+        case HIPPO_PRED_NOT: return scan_size(P->a);
+    }
+    return 1;
+}
+
+// A scan block holds the columns of up to SCAN_BLOCK stars, transposed from
+// the star array so that each predicate is evaluated by a loop over a single
+// column. Only the columns used by the predicate are gathered. Columns and
+// masks span a whole block, so SSE loops may run on to a multiple of four.
+
+#define SCAN_BLOCK 256
+
+#define SCAN_POS 1
+#define SCAN_V   2
+#define SCAN_BV  4
+
+struct scan_block
+{
+    float x [SCAN_BLOCK];
+    float y [SCAN_BLOCK];
+    float z [SCAN_BLOCK];
+    float v [SCAN_BLOCK];
+    float bv[SCAN_BLOCK];
+};
+
+// Return the columns used by the leaves of predicate P not decided by K.
+
+static int scan_cols(const hippo_pred *P, const scan_known *K, uint32_t *j)
+{
+    switch (P->op)
+    {
+        case HIPPO_PRED_AND:
+        case HIPPO_PRED_OR:
+        {
+            const int a = scan_cols(P->a, K, j);
+            const int b = scan_cols(P->b, K, j);
+            return a | b;
+        }
+        case HIPPO_PRED_NOT:
+            return scan_cols(P->a, K, j);
+
+        default:
+        {
+            const uint32_t i = (*j)++;
+            const uint32_t k = (i < 32) ? (1u << i) : 0;
+
+            if ((K->y | K->n) & k)
+                return 0;
+
+            switch (P->op)
+            {
+                case HIPPO_PRED_V:      return SCAN_V;
+                case HIPPO_PRED_BV:     return SCAN_BV;
+                case HIPPO_PRED_DIST:   return SCAN_POS;
+                case HIPPO_PRED_PLANES: return SCAN_POS;
+            }
+            return 0;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_SSE 1
+#endif
+
+// Set mask m to 1 for each of the c values of column x within lo through hi,
+// else 0.
+
+static void scan_range(const float *x, float lo, float hi, uint32_t c, uint32_t *m)
+{
+#ifdef SCAN_SSE
+    const __m128  l = _mm_set1_ps(lo);
+    const __m128  h = _mm_set1_ps(hi);
+    const __m128i u = _mm_set1_epi32(1);
+
+    for (uint32_t i = 0; i < c; i += 4)
+    {
+        const __m128 v = _mm_load_ps(x + i);
+        const __m128 k = _mm_and_ps(_mm_cmpge_ps(v, l), _mm_cmple_ps(v, h));
+
+        _mm_storeu_si128((__m128i *) (m + i), _mm_and_si128(_mm_castps_si128(k), u));
+    }
+#else
+    for (uint32_t i = 0; i < c; i++)
+        m[i] = (x[i] >= lo) & (x[i] <= hi);
+#endif
+}
+
+// Set mask m to 1 for each of the c stars of block B lying within lo through
+// hi of point p, else 0.
+
+static void scan_dist(const struct scan_block *B, const float *p,
+                      float lo, float hi, uint32_t c, uint32_t *m)
+{
+#ifdef SCAN_SSE
+    const __m128  px = _mm_set1_ps(p[0]);
+    const __m128  py = _mm_set1_ps(p[1]);
+    const __m128  pz = _mm_set1_ps(p[2]);
+    const __m128  l  = _mm_set1_ps(lo * lo);
+    const __m128  h  = _mm_set1_ps(hi * hi);
+    const __m128i u  = _mm_set1_epi32(1);
+
+    for (uint32_t i = 0; i < c; i += 4)
+    {
+        const __m128 dx = _mm_sub_ps(_mm_load_ps(B->x + i), px);
+        const __m128 dy = _mm_sub_ps(_mm_load_ps(B->y + i), py);
+        const __m128 dz = _mm_sub_ps(_mm_load_ps(B->z + i), pz);
+        const __m128 dd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                                _mm_mul_ps(dy, dy)),
+                                                _mm_mul_ps(dz, dz));
+        const __m128 k  = _mm_and_ps(_mm_cmpge_ps(dd, l), _mm_cmple_ps(dd, h));
+
+        _mm_storeu_si128((__m128i *) (m + i), _mm_and_si128(_mm_castps_si128(k), u));
+    }
+#else
+    for (uint32_t i = 0; i < c; i++)
+    {
+        const float dx = B->x[i] - p[0];
+        const float dy = B->y[i] - p[1];
+        const float dz = B->z[i] - p[2];
+        const float dd = dx * dx + dy * dy + dz * dz;
+
+        m[i] = (dd >= lo * lo) & (dd <= hi * hi);
+    }
+#endif
+}
+
+// Clear mask m for each of the c stars of block B behind plane v. A star on
+// the plane is kept, and the sum is taken in the order of point_test, so that
+// both agree exactly.
+
+static void scan_plane(const struct scan_block *B, const float *v,
+                       uint32_t c, uint32_t *m)
+{
+#ifdef SCAN_SSE
+    const __m128 a = _mm_set1_ps(v[0]);
+    const __m128 b = _mm_set1_ps(v[1]);
+    const __m128 d = _mm_set1_ps(v[2]);
+    const __m128 e = _mm_set1_ps(v[3]);
+    const __m128 z = _mm_setzero_ps();
+
+    for (uint32_t i = 0; i < c; i += 4)
+    {
+        const __m128 t = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(B->x + i), a),
+                                                          _mm_mul_ps(_mm_load_ps(B->y + i), b)),
+                                                          _mm_mul_ps(_mm_load_ps(B->z + i), d)), e);
+        const __m128i k = _mm_castps_si128(_mm_cmpge_ps(t, z));
+        const __m128i w = _mm_loadu_si128((const __m128i *) (m + i));
+
+        _mm_storeu_si128((__m128i *) (m + i), _mm_and_si128(w, k));
+    }
+#else
+    for (uint32_t i = 0; i < c; i++)
+        m[i] &= (B->x[i] * v[0] + B->y[i] * v[1] + B->z[i] * v[2] + v[3] >= 0);
+#endif
+}
+
+// Evaluate predicate P over the c stars of block B, giving a mask m of 1 for
+// each star that satisfies it and 0 for each that does not. Leaves decided by
+// K are not evaluated per star. Counter j gives the number of the next leaf.
+
+static void scan_eval(const hippo_pred *P, const scan_known *K, uint32_t *j,
+                      const struct scan_block *B, uint32_t c, uint32_t *m)
+{
+    uint32_t t[SCAN_BLOCK];
+    uint32_t i;
+    uint32_t k;
+
+    switch (P->op)
+    {
+        // Evaluate the second operand only if the first does not decide.
+
+        case HIPPO_PRED_AND:
+
+            scan_eval(P->a, K, j, B, c, m);
+
+            for (k = 0, i = 0; i < c; i++)
+                k |= m[i];
+
+            if (k)
+            {
+                scan_eval(P->b, K, j, B, c, t);
+
+                for (i = 0; i < c; i++)
+                    m[i] &= t[i];
+            }
+            else *j += scan_size(P->b);
+            break;
+
+        case HIPPO_PRED_OR:
+
+            scan_eval(P->a, K, j, B, c, m);
+
+            for (k = 1, i = 0; i < c; i++)
+                k &= m[i];
+
+            if (!k)
+            {
+                scan_eval(P->b, K, j, B, c, t);
+
+                for (i = 0; i < c; i++)
+                    m[i] |= t[i];
+            }
+            else *j += scan_size(P->b);
+            break;
+
+        case HIPPO_PRED_NOT:
+
+            scan_eval(P->a, K, j, B, c, m);
+
+            for (i = 0; i < c; i++)
+                m[i] ^= 1;
+            break;
+
+        default:
+        {
+            const uint32_t l = (*j)++;
+            const uint32_t b = (l < 32) ? (1u << l) : 0;
+
+            if ((K->y | K->n) & b)
+            {
+                for (i = 0; i < c; i++)
+                    m[i] = (K->y & b) ? 1 : 0;
+                break;
+            }
+
+            switch (P->op)
+            {
+                case HIPPO_PRED_V:
+                    scan_range(B->v,  P->min, P->max, c, m);
+                    break;
+
+                case HIPPO_PRED_BV:
+                    scan_range(B->bv, P->min, P->max, c, m);
+                    break;
+
+                case HIPPO_PRED_DIST:
+                    scan_dist(B, P->p, max(P->min, 0), P->max, c, m);
+                    break;
+
+                case HIPPO_PRED_PLANES:
+
+                    for (i = 0; i < c; i++)
+                        m[i] = 1;
+
+                    for (int p = 0; p < P->c; p++)
+                        scan_plane(B, P->v + p * 4, c, m);
+                    break;
+
+                default:
+
+                    for (i = 0; i < c; i++)
+                        m[i] = 0;
+            }
+        }
+    }
+}
+
+// Test the stars of leaf n against predicate P, given the known results K of
+// the leaf, in blocks, and append those that satisfy it to selection S.
+// Return 0 on failure.
+
+static int scan_leaf(const hippo *H, const hippo_pred *P, const scan_known *K,
+                     hippo_sel *S, uint32_t n, struct scan_block *B)
+{
+    const node *N = H->nodes + n;
+    uint32_t    m[SCAN_BLOCK];
+    uint32_t    j = 0;
+    float       o[3];
+    int         k;
+
+    node_offset(H->cents, n, o);
+
+    if (sel_grow(S, N->starc) == 0)
+        return 0;
+
+    if (H->pages)
+        page_node(H, n);
+
+    k = scan_cols(P, K, &j);
+
+    for (uint32_t s0 = N->star0; s0 < N->star0 + N->starc; s0 += SCAN_BLOCK)
+    {
+        const star    *T = H->stars + s0;
+        const uint32_t e = N->star0 + N->starc - s0;
+        const uint32_t c = (e < SCAN_BLOCK) ? e : SCAN_BLOCK;
+
+        if (k & SCAN_POS)
+            for (uint32_t i = 0; i < c; i++)
+            {
+                B->x[i] = T[i].pos[0] + o[0];
+                B->y[i] = T[i].pos[1] + o[1];
+                B->z[i] = T[i].pos[2] + o[2];
+            }
+        if (k & SCAN_V)
+            for (uint32_t i = 0; i < c; i++)
+                B->v[i] = T[i].mag[1];
+
+        if (k & SCAN_BV)
+            for (uint32_t i = 0; i < c; i++)
+                B->bv[i] = T[i].mag[0] - T[i].mag[1];
+
+        j = 0;
+        scan_eval(P, K, &j, B, c, m);
+
+        // Append the selected stars without branching.
+
+        for (uint32_t i = 0; i < c; i++)
+        {
+            S->index[S->c] = s0 + i;
+            S->c += m[i];
+        }
+    }
+    return 1;
+}
+
+// Scan the subtree at node n, given the known results K of its parent, and
+// append to selection S each star satisfying predicate P. Take whole nodes
+// that must satisfy it, skip those that cannot, and test the stars of leaves
+// that may. The internal nodes of a view are not contiguous, so a view is
+// taken leaf by leaf. Return 0 on failure.
+
+static int scan_node(const hippo *H, const hippo_pred *P, scan_known K,
+                     hippo_sel *S, uint32_t n, struct scan_block *B)
+{
+    const node *N = H->nodes + n;
+    const int   l = (N->nodeL == 0 || N->nodeR == 0);
+    uint32_t    j = 0;
+    int         r = scan_test(H, P, n, &K, &j);
+
+    if (r < 0 || N->starc == 0)
+        return 1;
+
+    if (r > 0 && (l || H->parent == NULL))
+    {
+        if (H->pages)
+            page_node(H, n);
+
+        return sel_range(S, N->star0, N->starc);
+    }
+
+    if (l)
+        return scan_leaf(H, P, &K, S, n, B);
+    else
+        return scan_node(H, P, K, S, N->nodeL, B)
+            && scan_node(H, P, K, S, N->nodeR, B);
+}
+
+// Gather into selection S the index of each star of catalog H that satisfies
+// predicate P, in increasing order, replacing its previous contents. Return 0
+// on failure.
+
+int hippo_scan(const hippo *H, const hippo_pred *P, hippo_sel *S)
+{
+    struct scan_block *B;
+    scan_known         K = { 0, 0 };
+    int                stat = 0;
+
+    S->c = 0;
+
+    if (H->nodec == 0)
+        return 1;
+
+    if ((B = (struct scan_block *) calloc(sizeof (struct scan_block), 1)))
+    {
+        stat = scan_node(H, P, K, S, 0, B);
+        free(B);
+    }
+    return stat;
 }
 
 //-----------------------------------------------------------------------------
@@ -30,23 +30,189 @@ struct star
     float mag[2];
 };
 
-typedef struct star  star;
-typedef struct hippo hippo;
+// The aggregate photometry of a set of stars: their luminosity-weighted
+// centroid, their total V-band luminosity as flux at 10 parsecs relative to
+// a zero-magnitude star, their flux-weighted B-V color, their total
+// V-band flux at the origin, the range of their V magnitudes, and their
+// number.
+
+struct aggr
+{
+    float    pos[3];
+    float    lum;
+    float    bv;
+    float    flux;
+    float    vmin;
+    float    vmax;
+    uint32_t count;
+};
+
+// A node of the spatial index: the bound of its stars, the first and count of
+// its stars, and the indices of its children, which are zero at a leaf.
+
+struct hippo_node
+{
+    float    bound[6];
+    uint32_t star0;
+    uint32_t starc;
+    uint32_t nodeL;
+    uint32_t nodeR;
+};
+
+// A list of star ranges, given as parallel arrays of first star indices and
+// star counts in the form taken by glMultiDrawArrays.
+
+struct hippo_list
+{
+    int     *first;
+    int     *count;
+    uint32_t c;
+    uint32_t n;
+};
+
+// A scan predicate is a node of an expression tree. A leaf selects stars with
+// V magnitude, B-V color, or distance from point p within min through max, or
+// stars within the set of c planes at v. An inner node selects the stars that
+// satisfy both of its operands a and b, either of them, or not operand a.
+
+#define HIPPO_PRED_V      1
+#define HIPPO_PRED_BV     2
+#define HIPPO_PRED_DIST   3
+#define HIPPO_PRED_PLANES 4
+#define HIPPO_PRED_AND    5
+#define HIPPO_PRED_OR     6
+#define HIPPO_PRED_NOT    7
+
+struct hippo_pred
+{
+    int                      op;
+    float                    min;
+    float                    max;
+    float                    p[3];
+    const float             *v;
+    int                      c;
+    const struct hippo_pred *a;
+    const struct hippo_pred *b;
+};
+
+// A selection vector, giving the indices of stars of a catalog.
+
+struct hippo_sel
+{
+    uint32_t *index;
+    uint32_t  c;
+    uint32_t  n;
+};
+
+typedef struct star         star;
+typedef struct aggr         aggr;
+typedef struct hippo        hippo;
+typedef struct hippo_node   hippo_node;
+typedef struct hippo_list   hippo_list;
+typedef struct hippo_pred   hippo_pred;
+typedef struct hippo_sel    hippo_sel;
+typedef struct hippo_cache  hippo_cache;
+typedef struct hippo_cut    hippo_cut;
+typedef struct hippo_async  hippo_async;
+typedef struct hippo_handle hippo_handle;
 
 //-----------------------------------------------------------------------------
 
+// Catalog ingestion flags: input in Tycho-2 rather than Hipparcos format, star
+// positions stored relative to the double-precision center of their leaf, the
+// stars of each leaf in Morton order, the whole catalog in Morton order, and
+// the stars of each leaf in order of magnitude, brightest first.
+
+#define HIPPO_TYC         1
+#define HIPPO_REBASE      2
+#define HIPPO_MORTON_LEAF 4
+#define HIPPO_MORTON_TREE 8
+#define HIPPO_BRIGHT_LEAF 16
+
 typedef void (*hippo_seek_fn)(const star *v, uint32_t c);
+typedef void (*hippo_seek_at_fn)(const star *v, uint32_t c, const double *p);
+typedef void (*hippo_pair_fn)(const uint32_t *p, uint32_t c);
+typedef void (*hippo_aggr_fn)(const aggr *a);
+typedef int  (*hippo_view_fn)(const star *s);
 
 hippo      *hippo_read    (const char *filename);
+hippo      *hippo_read_dat(const char *filename, uint32_t d, int f);
 hippo      *hippo_read_hip(const char *filename, uint32_t d);
 hippo      *hippo_read_tyc(const char *filename, uint32_t d);
+hippo      *hippo_attach  (const char *name);
+hippo      *hippo_view    (const hippo *H, hippo_view_fn fn);
 
 void        hippo_free (hippo *H);
+int         hippo_aggregate(hippo *H, int a);
+int         hippo_page (hippo *H, uint32_t k, uint32_t n);
 int         hippo_write(hippo *H, const char *filename);
+int         hippo_verify(const hippo *H, const char *cc);
+
+int         hippo_make_hip(const char *in, const char *out, uint32_t d, size_t m, int a);
+int         hippo_make_tyc(const char *in, const char *out, uint32_t d, size_t m, int a);
+
+int         hippo_publish  (hippo *H, const char *name);
+int         hippo_unpublish(const char *name);
 
 void        hippo_seek(const hippo *H, const float *v, int c, hippo_seek_fn fn);
+void        hippo_seek_at  (const hippo *H, const double *o,
+                            const float *v, int c, hippo_seek_at_fn fn);
+int         hippo_seek_list(const hippo *H, const float *v, int c, hippo_list *L);
+void        hippo_seek_zone(const hippo *H, const float *v, int c,
+                            const float *z, hippo_seek_fn fn);
+int         hippo_seek_list_zone(const hippo *H, const float *v, int c,
+                                 const float *z, hippo_list *L);
+void        hippo_seek_lod (const hippo *H, const float *v, int c,
+                            const float *M, float w, float t,
+                            hippo_seek_fn fn, hippo_aggr_fn af);
+void        hippo_aggr_star(star *s, const aggr *a);
+void        hippo_total    (const hippo *H, const float *v, int c, aggr *a);
+uint32_t    hippo_count    (const hippo *H, const float *v, int c, float m);
+void        hippo_seek_cone(const hippo *H, const float *p, const float *d,
+                            float a, float m, hippo_seek_fn fn);
+void        hippo_sky_dir  (float *d, double r, double e);
+uint32_t    hippo_seek_ray (const hippo *H, const float *p, const float *d,
+                            float t, float r, uint32_t n, uint32_t *hits);
+int         hippo_seek_rays(const hippo *H, const float *p, const float *d,
+                            uint32_t k, float t, float r, uint32_t n,
+                            uint32_t *hits, uint32_t *c);
+int         hippo_join     (const hippo *H, float r, int t, hippo_pair_fn fn);
+int         hippo_scan     (const hippo *H, const hippo_pred *P, hippo_sel *S);
 const star *hippo_data(const hippo *H);
 uint32_t    hippo_size(const hippo *H);
+const hippo_node *hippo_node_data(const hippo *H);
+uint32_t          hippo_node_size(const hippo *H);
+int         hippo_rebased(const hippo *H);
+void        hippo_node_center(const hippo *H, uint32_t n, double *p);
+uint32_t    hippo_star_node  (const hippo *H, uint32_t i);
+const hippo *hippo_parent(const hippo *H);
+
+int         hippo_list_append(hippo_list *L, uint32_t i, uint32_t c);
+void        hippo_list_free  (hippo_list *L);
+void        hippo_sel_free   (hippo_sel  *S);
+
+hippo_cache *hippo_cache_create(const hippo *H, uint32_t n);
+void         hippo_cache_free  (hippo_cache *C);
+void         hippo_cache_begin (hippo_cache *C, star *dst);
+int          hippo_cache_seek  (hippo_cache *C, const float *v, int c, hippo_list *L);
+void         hippo_cache_end   (hippo_cache *C);
+void         hippo_cache_reset (hippo_cache *C);
+
+hippo_cut   *hippo_cut_create(const hippo *H);
+void         hippo_cut_free  (hippo_cut *C);
+void         hippo_cut_update(hippo_cut *C, const float *v, int c,
+                              hippo_list *add, hippo_list *sub);
+void         hippo_cut_list  (hippo_cut *C, hippo_list *L);
+
+hippo_async      *hippo_async_create(const hippo *H, float e);
+void              hippo_async_free  (hippo_async *A);
+const hippo_list *hippo_async_seek  (hippo_async *A, const float *v, int c);
+
+hippo_handle *hippo_handle_create (hippo *H);
+void          hippo_handle_free   (hippo_handle *R);
+const hippo  *hippo_handle_acquire(hippo_handle *R, int *k);
+void          hippo_handle_release(hippo_handle *R, int k);
+void          hippo_handle_swap   (hippo_handle *R, hippo *H);
 
 void        hippo_view_bound(float *v, const float *M);
 void        hippo_cube_bound(float *v, const float *p, float d);
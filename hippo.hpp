@@ -0,0 +1,108 @@
+// Copyright (C) 2005-2013 Robert Kooima
+//
+// This file is part of Hippo.
+//
+// Hippo is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// Hippo is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along
+// with Hippo. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HIPPO_HPP
+#define HIPPO_HPP
+
+#include <stdint.h>
+
+#include "hippo.h"
+
+// A header-only C++ front-end to the queries of the C API. The plane count is
+// a template parameter, so that plane tests unroll, and the visitor is a
+// template parameter, so that it inlines. Both operate on the same node and
+// star arrays as the C API and produce the same lists of stars.
+
+namespace hip
+{
+    //--------------------------------------------------------------------------
+
+    namespace detail
+    {
+        // Test box b against the planes at v not yet known to contain it, as
+        // given by mask m. Return -1 if the box is wholly behind any plane,
+        // else clear from m the planes wholly containing the box. A box is
+        // behind a plane if its farthest corner is not in front, and within
+        // it if its nearest corner is in front.
+
+        template<int N>
+        inline int bound_test(const float *b, const float *v, unsigned& m)
+        {
+            for (int i = 0; i < N; i++, v += 4)
+                if (m & (1u << i))
+                {
+                    const float x0 = b[0] * v[0], x1 = b[3] * v[0];
+                    const float y0 = b[1] * v[1], y1 = b[4] * v[1];
+                    const float z0 = b[2] * v[2], z1 = b[5] * v[2];
+
+                    const float xmax = x0 > x1 ? x0 : x1, xmin = x0 > x1 ? x1 : x0;
+                    const float ymax = y0 > y1 ? y0 : y1, ymin = y0 > y1 ? y1 : y0;
+                    const float zmax = z0 > z1 ? z0 : z1, zmin = z0 > z1 ? z1 : z0;
+
+                    if (!(xmax + ymax + zmax + v[3] > 0))
+                        return -1;
+                    if (  xmin + ymin + zmin + v[3] > 0)
+                        m &= ~(1u << i);
+                }
+
+            return m ? 0 : 1;
+        }
+
+        // Visit each node beneath node n whose stars fall within the planes.
+        // Planes wholly containing a node are not tested against its children.
+        // Unless w, as in a view or rebased catalog, descend to the leaves of
+        // such a node.
+
+        template<int N, typename F>
+        void traverse(const hippo_node *T, const star *S, const float *v,
+                      unsigned m, uint32_t n, bool w, F& f)
+        {
+            const hippo_node *t = T + n;
+
+            if (bound_test<N>(t->bound, v, m) >= 0)
+            {
+                if ((m == 0 && w) || t->nodeL == 0 || t->nodeR == 0)
+                    f(S + t->star0, t->starc);
+                else
+                {
+                    traverse<N>(T, S, v, m, t->nodeL, w, f);
+                    traverse<N>(T, S, v, m, t->nodeR, w, f);
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Call f with each list of stars of catalog H that falls within the set of
+    // N planes at v, as does hippo_seek. F may be any callable taking a const
+    // star pointer and a uint32_t count.
+
+    template<int N, typename F>
+    void seek(const hippo *H, const float *v, F&& f)
+    {
+        static_assert(N > 0 && N <= 32, "plane count must lie within 1 to 32");
+
+        if (hippo_node_size(H))
+            detail::traverse<N>(hippo_node_data(H), hippo_data(H), v,
+                                (N == 32) ? ~0u : (1u << N) - 1, 0,
+                                hippo_parent(H) == NULL &&
+                                hippo_rebased(H) == 0, f);
+    }
+}
+
+#endif
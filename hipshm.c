@@ -0,0 +1,97 @@
+// Copyright (C) 2005-2013 Robert Kooima
+//
+// This file is part of Hippo.
+//
+// Hippo is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// Hippo is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+// details.
+//
+// You should have received a copy of the GNU General Public License along
+// with Hippo. If not, see <http://www.gnu.org/licenses/>.
+
+#include <signal.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "hippo.h"
+
+static volatile sig_atomic_t reload = 0;
+static volatile sig_atomic_t finish = 0;
+
+static void handle(int sig)
+{
+    if (sig == SIGHUP)
+        reload = 1;
+    else
+        finish = 1;
+}
+
+// Publish each named catalog. Catalogs that fail to load or verify keep their
+// previous publication, if any.
+
+static void publish(int argc, char *argv[])
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        hippo *H;
+
+        if ((H = hippo_read(argv[i + 1])) && hippo_verify(H, NULL)
+                                          && hippo_publish(H, argv[i]))
+            printf("%s: published %s as %s\n", argv[0], argv[i + 1], argv[i]);
+        else
+            fprintf(stderr, "%s: failed to publish %s\n", argv[0], argv[i + 1]);
+
+        hippo_free(H);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && argc % 2 == 1)
+    {
+        sigset_t mask;
+        sigset_t prev;
+
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGHUP);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigprocmask(SIG_BLOCK, &mask, &prev);
+
+        signal(SIGHUP,  handle);
+        signal(SIGINT,  handle);
+        signal(SIGTERM, handle);
+
+        // Publish all catalogs, republish them on hangup, and withdraw them
+        // on termination.
+
+        publish(argc, argv);
+
+        while (!finish)
+        {
+            sigsuspend(&prev);
+
+            if (reload)
+            {
+                reload = 0;
+                publish(argc, argv);
+            }
+        }
+
+        for (int i = 1; i + 1 < argc; i += 2)
+            hippo_unpublish(argv[i]);
+
+        return 0;
+    }
+
+    fprintf(stderr, "Usage: %s /name catalog.riff [/name catalog.riff ...]\n",
+                     argv[0]);
+    return 1;
+}
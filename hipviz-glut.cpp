@@ -26,7 +26,7 @@
 #endif
 
 extern bool animating();
-extern void init();
+extern void init(int, char **);
 extern void draw();
 extern void step();
 extern void resize(int, int);
@@ -116,7 +116,8 @@ int main(int argc, char *argv[])
                 glGetString(GL_VERSION),
                 glGetString(GL_SHADING_LANGUAGE_VERSION));
 
-        init();
+        init(argc, argv);
+        update();
         glutMainLoop();
     }
     return 0;
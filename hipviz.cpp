@@ -16,9 +16,13 @@
 // with Hippo. If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdint.h>
+#include <time.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "hippo.h"
+#include "camera.h"
 #include "gl.hpp"
 
 using namespace gl;
@@ -35,10 +39,12 @@ static GLint  mloc    = -1;
 static GLint  Ploc    = -1;
 static GLint  Mloc    = -1;
 static GLint  bloc    = -1;
+static GLint  Cloc    = -1;
+static GLint  Oloc    = -1;
 
 static float fov = 45.0f;
-static vec3  view_rotation;
-static vec3  view_position;
+static vec3   view_rotation;
+static double view_position[3];
 static vec3  view_movement;
 
 static hippo *H = 0;
@@ -46,8 +52,41 @@ static hippo *T = 0;
 
 static GLuint H_vao;
 static GLuint T_vao;
+static GLuint H_vbo;
+static GLuint T_vbo;
 static GLuint tex;
 
+static uint32_t     stream_size = 0;
+static hippo_cache *H_cache     = 0;
+static hippo_cache *T_cache     = 0;
+static GLsync       H_sync      = 0;
+static GLsync       T_sync      = 0;
+static hippo_cut   *H_cut       = 0;
+static hippo_cut   *T_cut       = 0;
+
+static float        async_dist  = 0;
+static hippo_async *H_async     = 0;
+static hippo_async *T_async     = 0;
+
+static hippo_list H_list;
+static hippo_list T_list;
+
+static float             lod_pixels = 0;
+static GLuint            lod_vao;
+static GLuint            lod_vbo;
+static hippo_list       *lod_list;
+static const star       *lod_data;
+static std::vector<star> lod_stars;
+
+static const star       *at_data;
+static const double     *at_view;
+
+static FILE               *path_record = 0;
+static std::vector<double> path;
+static size_t              path_frame  = 0;
+static std::vector<double> cull_times;
+static std::vector<double> draw_times;
+
 static vec3  click_rotation;
 static float click_fov;
 static int   click_x;
@@ -67,13 +106,92 @@ static const GLfloat spectrum[6][3] = {
 
 bool animating()
 {
-    return (view_movement[0] || view_movement[1] || view_movement[2]);
+    return (view_movement[0] || view_movement[1] || view_movement[2])
+        || !path.empty();
+}
+
+double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Camera path replay. Each line of a path file gives the view rotation, view
+// position, and field of view of one frame, as recorded by option -R.
+
+void read_path(const char *filename)
+{
+    if (FILE *fp = fopen(filename, "r"))
+    {
+        double f[7];
+
+        while (fscanf(fp, "%lf %lf %lf %lf %lf %lf %lf", f + 0, f + 1, f + 2,
+                                                         f + 3, f + 4, f + 5,
+                                                         f + 6) == 7)
+            path.insert(path.end(), f, f + 7);
+
+        fclose(fp);
+    }
+}
+
+void goto_path(size_t i)
+{
+    const double *f = &path[i * 7];
+
+    view_rotation    = vec3(GLfloat(f[0]), GLfloat(f[1]), GLfloat(f[2]));
+    view_position[0] = f[3];
+    view_position[1] = f[4];
+    view_position[2] = f[5];
+    fov              = GLfloat(f[6]);
+}
+
+// Report the mean and maximum of the cull and draw times of a replay.
+
+void report_path()
+{
+    double cull_sum = 0, cull_max = 0;
+    double draw_sum = 0, draw_max = 0;
+
+    for (size_t i = 0; i < cull_times.size(); i++)
+    {
+        cull_sum += cull_times[i]; cull_max = std::max(cull_max, cull_times[i]);
+        draw_sum += draw_times[i]; draw_max = std::max(draw_max, draw_times[i]);
+    }
+    if (size_t n = cull_times.size())
+        fprintf(stderr, "cull: mean %.3f  max %.3f ms\n"
+                        "draw: mean %.3f  max %.3f ms\n",
+                        cull_sum * 1000 / n, cull_max * 1000,
+                        draw_sum * 1000 / n, draw_max * 1000);
+}
+
+// Return the row-major camera matrix m as a mat4.
+
+mat4 to_mat4(const float *m)
+{
+    return mat4(m[ 0], m[ 1], m[ 2], m[ 3],
+                m[ 4], m[ 5], m[ 6], m[ 7],
+                m[ 8], m[ 9], m[10], m[11],
+                m[12], m[13], m[14], m[15]);
+}
+
+// Return the projection of field of view v.
+
+mat4 projection(float v)
+{
+    float P[16];
+    camera_projection(P, v, window_aspect);
+    return to_mat4(P);
 }
 
-mat4 orientation(vec3 r)
+// Return the model-view with which to draw catalog H, as Tycho-2 if t.
+
+mat4 modelview(const hippo *H, bool t)
 {
-    return xrotation(to_radians(r[0]))
-         * yrotation(to_radians(r[1]));
+    float M[16];
+    camera_view(M, view_rotation[0], view_rotation[1],
+                camera_moves(t, hippo_rebased(H)) ? view_position : NULL);
+    return to_mat4(M);
 }
 
 mat4 occidentation(vec3 r)
@@ -82,20 +200,26 @@ mat4 occidentation(vec3 r)
          * xrotation(to_radians(-r[0]));
 }
 
-GLuint init_vao(hippo *H)
+GLuint init_vao(hippo *H, GLuint& vbo)
 {
     GLuint vao = 0;
-    GLuint vbo = 0;
 
-    if (H)
+    if (H || lod_pixels > 0)
     {
         glGenVertexArrays(1, &vao);
         glBindVertexArray(vao);
 
         glGenBuffers(1, &vbo);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER,  hippo_size(H) * sizeof (star),
-                                       hippo_data(H), GL_STATIC_DRAW);
+
+        if (H == 0)
+            glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STREAM_DRAW);
+        else if (stream_size && !hippo_rebased(H))
+            glBufferData(GL_ARRAY_BUFFER, stream_size * sizeof (star),
+                                          NULL, GL_STREAM_DRAW);
+        else
+            glBufferData(GL_ARRAY_BUFFER, hippo_size(H) * sizeof (star),
+                                          hippo_data(H), GL_STATIC_DRAW);
 
         glEnableVertexAttribArray(ploc);
         glEnableVertexAttribArray(mloc);
@@ -108,8 +232,31 @@ GLuint init_vao(hippo *H)
     return vao;
 }
 
-void init()
+void init(int argc, char *argv[])
 {
+    for (int i = 1; i < argc; i++)
+        if (std::string(argv[i]) == "-s" && i + 1 < argc)
+            stream_size = (uint32_t) strtol(argv[++i], 0, 0);
+        else if (std::string(argv[i]) == "-l" && i + 1 < argc)
+            lod_pixels = (float) strtod(argv[++i], 0);
+        else if (std::string(argv[i]) == "-a" && i + 1 < argc)
+            async_dist = (float) strtod(argv[++i], 0);
+        else if (std::string(argv[i]) == "-p" && i + 1 < argc)
+            read_path(argv[++i]);
+        else if (std::string(argv[i]) == "-R" && i + 1 < argc)
+            path_record = fopen(argv[++i], "w");
+
+    // Record line by line, as the application exits without notice.
+
+    if (path_record)
+        setvbuf(path_record, NULL, _IOLBF, 0);
+
+    if (!path.empty())
+    {
+        goto_path(0);
+        printf("frame\tcull\tdraw\tranges\n");
+    }
+
     const std::string glsl((const char *) glGetString(GL_SHADING_LANGUAGE_VERSION));
 
     program = 0;
@@ -126,6 +273,8 @@ void init()
         Ploc = glGetUniformLocation(program, "P");
         Mloc = glGetUniformLocation(program, "M");
         bloc = glGetUniformLocation(program, "brightness");
+        Cloc = glGetUniformLocation(program, "C");
+        Oloc = glGetUniformLocation(program, "O");
     }
     else printf("Failed to initialize GLSL shader.\n");
 
@@ -137,8 +286,28 @@ void init()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    if ((H = hippo_read("hipparcos.riff"))) H_vao = init_vao(H);
-    if ((T = hippo_read("tycho.riff")))     T_vao = init_vao(T);
+    if ((H = hippo_read("hipparcos.riff"))) H_vao = init_vao(H, H_vbo);
+    if ((T = hippo_read("tycho.riff")))     T_vao = init_vao(T, T_vbo);
+
+    lod_vao = init_vao(0, lod_vbo);
+
+    // Rebased catalogs are drawn leaf by leaf, and need neither.
+
+    if (stream_size)
+    {
+        if (H && !hippo_rebased(H)) H_cache = hippo_cache_create(H, stream_size);
+        if (T && !hippo_rebased(T)) T_cache = hippo_cache_create(T, stream_size);
+    }
+    else if (async_dist > 0 && lod_pixels == 0)
+    {
+        if (H && !hippo_rebased(H)) H_async = hippo_async_create(H, async_dist);
+        if (T && !hippo_rebased(T)) T_async = hippo_async_create(T, async_dist);
+    }
+    else
+    {
+        if (H && !hippo_rebased(H)) H_cut = hippo_cut_create(H);
+        if (T && !hippo_rebased(T)) T_cut = hippo_cut_create(T);
+    }
 
 #ifdef GL_POINT_SPRITE
     glEnable(GL_POINT_SPRITE);
@@ -148,56 +317,292 @@ void init()
     glBlendFunc(GL_ONE, GL_ONE);
 }
 
-void draw_H(const star *v, uint32_t c)
+void draw_list(const hippo_list& L)
+{
+    if (L.c)
+        glMultiDrawArrays(GL_POINTS, L.first, L.count, L.c);
+}
+
+// Level-of-detail call-backs. List visible stars and accumulate stand-ins for
+// the aggregates of subtrees too small to resolve.
+
+void lod_seek(const star *v, uint32_t c)
+{
+    hippo_list_append(lod_list, uint32_t(v - lod_data), c);
+}
+
+void lod_aggr(const aggr *a)
+{
+    star s;
+    hippo_aggr_star(&s, a);
+    lod_stars.push_back(s);
+}
+
+void draw_lod()
+{
+    if (!lod_stars.empty())
+    {
+        glBindVertexArray(lod_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, lod_vbo);
+        glBufferData(GL_ARRAY_BUFFER, lod_stars.size() * sizeof (star),
+                                     &lod_stars.front(), GL_STREAM_DRAW);
+        glDrawArrays(GL_POINTS, 0, GLsizei(lod_stars.size()));
+
+        lod_stars.clear();
+    }
+}
+
+// Fence the draws of the current frame from a streaming buffer.
+
+void fence(GLsync& S)
+{
+    if (S) glDeleteSync(S);
+    S = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Wait for the GPU to finish the draws fenced by S.
+
+void wait(GLsync& S)
+{
+    if (S)
+    {
+        while (glClientWaitSync(S, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)
+                                                        == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(S);
+        S = 0;
+    }
+}
+
+// Find the stars of catalog H visible within the planes v. When streaming,
+// copy any not yet resident into its vertex buffer and list their positions
+// there. The buffer is mapped without synchronization, so first wait for the
+// fence S of the previous frame, after which no range that may be evicted is
+// still being read. If the mapping is lost, so is the cache, and if the list
+// cannot be grown, nothing is drawn. With level-of-detail, gather the stand-
+// ins of subtrees smaller than the threshold under projection PM. When
+// querying asynchronously, return the list found for the previous frame,
+// which the query owns. Otherwise, update the visible set of the previous
+// frame. Return the list to draw.
+
+const hippo_list *seek_list(hippo *H, hippo_cache *C, hippo_cut *K,
+                            hippo_async *A, GLuint vbo, GLsync& S,
+                            const mat4& PM, const float *v, hippo_list& L)
 {
-    glDrawArrays(GL_POINTS, v - hippo_data(H), c);
+    if (A)
+    {
+        if (const hippo_list *F = hippo_async_seek(A, v, 6))
+            return F;
+        else
+            L.c = 0;
+    }
+    else if (C)
+    {
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+        L.c = 0;
+
+        wait(S);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+        if (void *p = glMapBufferRange(GL_ARRAY_BUFFER, 0,
+                                       stream_size * sizeof (star), access))
+        {
+            hippo_cache_begin(C, (star *) p);
+
+            if (hippo_cache_seek(C, v, 6, &L) == 0)
+                L.c = 0;
+
+            hippo_cache_end(C);
+
+            if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
+            {
+                hippo_cache_reset(C);
+                L.c = 0;
+            }
+        }
+    }
+    else if (lod_pixels > 0)
+    {
+        lod_list = &L;
+        lod_data = hippo_data(H);
+
+        L.c = 0;
+
+        hippo_seek_lod(H, v, 6, PM, window_w, lod_pixels, lod_seek, lod_aggr);
+    }
+    else if (K)
+    {
+        hippo_cut_update(K, v, 6, NULL, NULL);
+        hippo_cut_list  (K, &L);
+    }
+    else hippo_seek_list(H, v, 6, &L);
+
+    return &L;
 }
 
-void draw_T(const star *v, uint32_t c)
+// Draw each leaf of a rebased catalog found visible from observer o within
+// planes v relative to o. Position the leaf relative to the observer in double
+// precision, leaving only small offsets to the single-precision pipeline.
+
+void draw_at(const star *v, uint32_t c, const double *p)
 {
-    glDrawArrays(GL_POINTS, v - hippo_data(T), c);
+    glUniform3f(Cloc, GLfloat(p[0]), GLfloat(p[1]), GLfloat(p[2]));
+    glUniform3f(Oloc, GLfloat(p[0] - at_view[0]),
+                      GLfloat(p[1] - at_view[1]),
+                      GLfloat(p[2] - at_view[2]));
+    glDrawArrays(GL_POINTS, GLint(v - at_data), GLsizei(c));
 }
 
+void seek_at(hippo *H, const double *o, const float *v)
+{
+    at_data = hippo_data(H);
+    at_view = o;
+
+    hippo_seek_at(H, o, v, 6, draw_at);
+
+    glUniform3f(Cloc, 0.0f, 0.0f, 0.0f);
+    glUniform3f(Oloc, 0.0f, 0.0f, 0.0f);
+}
+
+// Draw the scene, timing the cull and draw stages separately. A rebased
+// catalog draws as it culls, and its time counts toward the cull. When
+// replaying a camera path, finish rendering before timing the draw so that it
+// includes the work of the GPU, and log both times.
+
 void draw()
 {
-    float v[24];
+    float    v[24];
+    double   cull = 0;
+    double   t0   = now();
+    uint32_t c    = 0;
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    mat4 P = perspective(to_radians(fov), window_aspect, 1.f, 10000.f);
+    mat4 P = projection(fov);
+
+    // Asynchronous queries lag by one frame. Their planes are pushed outward
+    // to cover movement, and the field of view is widened to cover turning.
+
+    mat4 Q = P;
+
+    if (H_async || T_async)
+        Q = projection(camera_lag(fov));
 
     glUseProgram(program);
     glUniformMatrix4fv(Ploc, 1, GL_TRUE, P);
     glUniform1f       (bloc, 32.0f * 45.0f / fov);
 
-    if (H)
+    if (H && hippo_rebased(H))
     {
-        mat4 M = orientation(view_rotation)
-               * translation(view_position);
+        const double o[3] = { -view_position[0],
+                              -view_position[1],
+                              -view_position[2] };
+
+        mat4 M = modelview(H, false);
 
         hippo_view_bound(v, P * M);
 
         glUniformMatrix4fv(Mloc, 1, GL_TRUE, M);
         glBindVertexArray(H_vao);
-        hippo_seek(H, v, 6, draw_H);
+
+        double t = now();
+        seek_at(H, o, v);
+        cull += now() - t;
+    }
+    else if (H)
+    {
+        mat4 M = modelview(H, false);
+
+        hippo_view_bound(v, Q * M);
+
+        glUniformMatrix4fv(Mloc, 1, GL_TRUE, M);
+        glBindVertexArray(H_vao);
+
+        double t = now();
+        const hippo_list *L = seek_list(H, H_cache, H_cut, H_async, H_vbo,
+                                        H_sync, P * M, v, H_list);
+        cull += now() - t;
+
+        draw_list(*L);
+        if (H_cache) fence(H_sync);
+        c += L->c;
+        draw_lod();
     }
     if (T)
     {
-        mat4 M = orientation(view_rotation);
+        const double o[3] = { 0.0, 0.0, 0.0 };
 
-        hippo_view_bound(v, P * M);
+        mat4 M = modelview(T, true);
+
+        hippo_view_bound(v, Q * M);
 
         glUniformMatrix4fv(Mloc, 1, GL_TRUE, M);
         glBindVertexArray(T_vao);
-        hippo_seek(T, v, 6, draw_T);
+
+        double t = now();
+
+        if (hippo_rebased(T))
+        {
+            seek_at(T, o, v);
+            cull += now() - t;
+        }
+        else
+        {
+            const hippo_list *L = seek_list(T, T_cache, T_cut, T_async, T_vbo,
+                                            T_sync, P * M, v, T_list);
+            cull += now() - t;
+
+            draw_list(*L);
+            if (T_cache) fence(T_sync);
+            draw_lod();
+            c += L->c;
+        }
+    }
+
+    if (path_record)
+        fprintf(path_record, "%f %f %f %f %f %f %f\n",
+                view_rotation[0], view_rotation[1], view_rotation[2],
+                view_position[0], view_position[1], view_position[2], fov);
+
+    if (!path.empty())
+    {
+        glFinish();
+
+        double draw = now() - t0 - cull;
+
+        cull_times.push_back(cull);
+        draw_times.push_back(draw);
+
+        printf("%zu\t%.3f\t%.3f\t%u\n", path_frame, cull * 1000,
+                                                     draw * 1000, c);
     }
 }
 
+// Advance the camera to the next frame of the path being replayed, exiting
+// after the last, or move it as directed by the keyboard.
+
 void step()
 {
-    if (length(view_movement) > 0.0)
-        view_position = view_position + normal(occidentation(view_rotation)) * normalize(view_movement);
+    if (!path.empty())
+    {
+        if (++path_frame < path.size() / 7)
+            goto_path(path_frame);
+        else
+        {
+            report_path();
+            exit(0);
+        }
+    }
+    else if (length(view_movement) > 0.0)
+    {
+        vec3 d = normal(occidentation(view_rotation)) * normalize(view_movement);
+
+        view_position[0] += d[0];
+        view_position[1] += d[1];
+        view_position[2] += d[2];
+    }
 }
 
 void resize(int width, int height)
@@ -4,6 +4,8 @@ uniform mat4 P;
 uniform mat4 M;
 uniform float brightness;
 uniform sampler2D spectrum;
+uniform vec3 C;
+uniform vec3 O;
 
 attribute vec4 Position;
 attribute vec2 Magnitude;
@@ -12,8 +14,11 @@ varying vec4 color;
 
 void main()
 {
-    float d0 = length(vec3(    Position)) * 0.306594845;
-    float d1 = length(vec3(M * Position)) * 0.306594845;
+    vec4 p0 = vec4(Position.xyz + C, 1.0);
+    vec4 p1 = vec4(Position.xyz + O, 1.0);
+
+    float d0 = length(vec3(    p0)) * 0.306594845;
+    float d1 = length(vec3(M * p1)) * 0.306594845;
 
     float bv =               0.850 * (Magnitude.x - Magnitude.y);
     float m0 = Magnitude.y - 0.090 * (Magnitude.x - Magnitude.y);
@@ -22,5 +27,5 @@ void main()
     color = mix(vec4(0.7), vec4(1.0), texture(spectrum, vec2((bv + 0.3) / 1.7, 0.0)));
 
     gl_PointSize = pow(10.0, -0.15 * m1) * brightness;
-    gl_Position  = P * M * Position;
+    gl_Position  = P * M * p1;
 }